@@ -0,0 +1,124 @@
+#include "addr_tree.h"
+#include <stdlib.h>
+#include <assert.h>
+
+static unsigned long long priority(struct nodeStruct *node);
+static void rotateLeft(struct nodeStruct **rootRef);
+static void rotateRight(struct nodeStruct **rootRef);
+
+
+/*
+ * Insert node into the tree rooted at *rootRef.
+ * No node with the same ptr may already be in the tree.
+ */
+void Tree_insert (struct nodeStruct **rootRef, struct nodeStruct *node)
+{
+    struct nodeStruct *root = *rootRef;
+
+    if (root == NULL){
+        node->left = NULL;
+        node->right = NULL;
+        *rootRef = node;
+        return;
+    }
+
+    assert(node->ptr != root->ptr);
+    if ((char*)node->ptr < (char*)root->ptr){
+        Tree_insert(&root->left, node);
+        if (priority(root->left) > priority(root)){
+            rotateRight(rootRef);
+        }
+    } else {
+        Tree_insert(&root->right, node);
+        if (priority(root->right) > priority(root)){
+            rotateLeft(rootRef);
+        }
+    }
+}
+
+/*
+ * Remove node from the tree rooted at *rootRef.
+ * This function assumes that node is in the tree.
+ */
+void Tree_remove (struct nodeStruct **rootRef, struct nodeStruct *node)
+{
+    /* Find the link that points at node */
+    while (*rootRef != node){
+        assert(*rootRef != NULL);
+        if ((char*)node->ptr < (char*)(*rootRef)->ptr){
+            rootRef = &(*rootRef)->left;
+        } else {
+            rootRef = &(*rootRef)->right;
+        }
+    }
+
+    /* Rotate it down until it is a leaf, keeping the heap order on priorities */
+    while (node->left != NULL || node->right != NULL){
+        if (node->right == NULL
+                || (node->left != NULL && priority(node->left) > priority(node->right))){
+            rotateRight(rootRef);
+            rootRef = &(*rootRef)->right;
+        } else {
+            rotateLeft(rootRef);
+            rootRef = &(*rootRef)->left;
+        }
+    }
+    *rootRef = NULL;
+}
+
+/*
+ * Return the node with the greatest ptr strictly below ptr,
+ * or NULL if there is none.
+ * If steps is not NULL, the number of nodes visited is added to *steps.
+ */
+struct nodeStruct* Tree_findBefore (struct nodeStruct *root, void *ptr, long long *steps)
+{
+    struct nodeStruct *ret = NULL;
+
+    while (root != NULL){
+        if (steps != NULL){
+            ++*steps;
+        }
+        if ((char*)root->ptr < (char*)ptr){
+            ret = root;
+            root = root->right;
+        } else {
+            root = root->left;
+        }
+    }
+    return ret;
+}
+
+
+/* Mixes the node's address (splitmix64 finalizer) into a pseudo-random priority. */
+static unsigned long long priority(struct nodeStruct *node)
+{
+    unsigned long long x = (unsigned long long)(size_t)node;
+
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+static void rotateLeft(struct nodeStruct **rootRef)
+{
+    struct nodeStruct *root = *rootRef;
+    struct nodeStruct *pivot = root->right;
+
+    root->right = pivot->left;
+    pivot->left = root;
+    *rootRef = pivot;
+}
+
+static void rotateRight(struct nodeStruct **rootRef)
+{
+    struct nodeStruct *root = *rootRef;
+    struct nodeStruct *pivot = root->left;
+
+    root->left = pivot->right;
+    pivot->right = root;
+    *rootRef = pivot;
+}
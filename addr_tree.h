@@ -0,0 +1,37 @@
+// Address-ordered tree over free blocks.
+
+#ifndef ADDR_TREE_H_
+#define ADDR_TREE_H_
+
+#include "list_sol.h"
+
+/*
+ * The free blocks are indexed by a treap keyed on their ptr field, so that
+ * kfree can find where a block belongs in address order without walking
+ * the free list. Only the left and right fields of a node are used here;
+ * the node's priority is derived from its own address, which never changes.
+ *
+ * A node's ptr may be moved while it is in the tree as long as it stays
+ * between the ptr of its predecessor and its successor.
+ */
+
+/*
+ * Insert node into the tree rooted at *rootRef.
+ * No node with the same ptr may already be in the tree.
+ */
+void Tree_insert (struct nodeStruct **rootRef, struct nodeStruct *node);
+
+/*
+ * Remove node from the tree rooted at *rootRef.
+ * This function assumes that node is in the tree.
+ */
+void Tree_remove (struct nodeStruct **rootRef, struct nodeStruct *node);
+
+/*
+ * Return the node with the greatest ptr strictly below ptr,
+ * or NULL if there is none.
+ * If steps is not NULL, the number of nodes visited is added to *steps.
+ */
+struct nodeStruct* Tree_findBefore (struct nodeStruct *root, void *ptr, long long *steps);
+
+#endif
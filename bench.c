@@ -0,0 +1,887 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "kallocator.h"
+
+/* Allocator benchmarks.
+ * Run "kbench <name>" for a single benchmark, or "kbench" for all of them. */
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+
+/* Sets up a heap of alternating 16 byte live blocks and n 16 byte holes,
+ * then repeatedly frees and reallocates a random block out of a window,
+ * returning the average time of each call. */
+static void run_free_chunks(int n, int flags, double *allocNs, double *freeNs){
+    const int blockSize = 16;
+    const int ops = 200000;
+    /* Room for the tags, if any, so that n holes are left */
+    int blockExtent = (flags & KALLOC_BOUNDARY_TAGS) ? blockSize + 8 : blockSize;
+    void **blocks = malloc(sizeof(void*) * 2 * n);
+    void *inFlight[64];
+    int window = (n < 64) ? n : 64;
+    double allocTime = 0;
+    double freeTime = 0;
+
+    initialize_allocator_flags(2 * n * blockExtent, FIRST_FIT, flags);
+    for (int i = 0; i < 2 * n; ++i){
+        blocks[i] = kalloc(blockSize);
+    }
+    for (int i = 2 * n - 2; i >= 0; i -= 2){
+        kfree(blocks[i]);
+    }
+    for (int i = 0; i < window; ++i){
+        inFlight[i] = kalloc(blockSize);
+    }
+
+    srand(1);
+    for (int i = 0; i < ops; ++i){
+        int victim = rand() % window;
+        double t0 = now_ns();
+        kfree(inFlight[victim]);
+        double t1 = now_ns();
+        inFlight[victim] = kalloc(blockSize);
+        double t2 = now_ns();
+
+        freeTime += t1 - t0;
+        allocTime += t2 - t1;
+    }
+
+    *allocNs = allocTime / ops;
+    *freeNs = freeTime / ops;
+
+    destroy_allocator();
+    free(blocks);
+}
+
+/* free_chunks: cost of kalloc and kfree as the number of free chunks grows. */
+static void bench_free_chunks(void){
+    printf("free_chunks: per-operation cost vs number of free chunks (FIRST_FIT)\n");
+    printf("%10s %12s %12s\n", "chunks", "ns/kalloc", "ns/kfree");
+
+    for (int n = 10; n <= 100000; n *= 10){
+        double allocNs, freeNs;
+        run_free_chunks(n, 0, &allocNs, &freeNs);
+        printf("%10d %12.1f %12.1f\n", n, allocNs, freeNs);
+    }
+}
+
+/* boundary_tags: the free_chunks workload with and without in-band tags. */
+static void bench_boundary_tags(void){
+    printf("boundary_tags: kfree cost with address-ordered lists vs boundary tags (FIRST_FIT)\n");
+    printf("%10s %16s %16s\n", "chunks", "ns/kfree lists", "ns/kfree tags");
+
+    for (int n = 100; n <= 100000; n *= 10){
+        double allocNs, listFreeNs, tagFreeNs;
+        run_free_chunks(n, 0, &allocNs, &listFreeNs);
+        run_free_chunks(n, KALLOC_BOUNDARY_TAGS, &allocNs, &tagFreeNs);
+        printf("%10d %16.1f %16.1f\n", n, listFreeNs, tagFreeNs);
+    }
+}
+
+
+/* live_objects: cost of kfree as the number of live allocations grows.
+ * Random live blocks are freed and immediately reallocated. */
+static void bench_live_objects(void){
+    const int blockSize = 16;
+    const int ops = 200000;
+
+    printf("live_objects: per-operation cost vs number of live blocks (FIRST_FIT)\n");
+    printf("%10s %12s %12s\n", "live", "ns/kalloc", "ns/kfree");
+
+    for (int n = 1000; n <= 1000000; n *= 10){
+        void **blocks = malloc(sizeof(void*) * n);
+        double allocTime = 0;
+        double freeTime = 0;
+
+        initialize_allocator(n * blockSize, FIRST_FIT);
+        for (int i = 0; i < n; ++i){
+            blocks[i] = kalloc(blockSize);
+        }
+
+        srand(1);
+        for (int i = 0; i < ops; ++i){
+            int victim = rand() % n;
+            double t0 = now_ns();
+            kfree(blocks[victim]);
+            double t1 = now_ns();
+            blocks[victim] = kalloc(blockSize);
+            double t2 = now_ns();
+
+            freeTime += t1 - t0;
+            allocTime += t2 - t1;
+        }
+
+        printf("%10d %12.1f %12.1f\n", n, allocTime / ops, freeTime / ops);
+
+        destroy_allocator();
+        free(blocks);
+    }
+}
+
+/* metadata: metadata footprint and malloc calls before and after a long
+ * steady-state churn; the malloc call count should not move. */
+static void bench_metadata(void){
+    const int live = 10000;
+    const int ops = 1000000;
+    void **blocks = malloc(sizeof(void*) * live);
+
+    printf("metadata: statistics after warm-up and after %d kfree/kalloc pairs\n", ops);
+
+    initialize_allocator(live * 256, BEST_FIT);
+    srand(1);
+    for (int i = 0; i < live; ++i){
+        blocks[i] = kalloc(1 + rand() % 128);
+    }
+    print_statistics();
+
+    for (int i = 0; i < ops; ++i){
+        int victim = rand() % live;
+        kfree(blocks[victim]);
+        blocks[victim] = kalloc(1 + rand() % 128);
+    }
+    printf("\n");
+    print_statistics();
+
+    destroy_allocator();
+    free(blocks);
+}
+
+static const char *algorithmNames[] = {"FIRST_FIT", "BEST_FIT", "WORST_FIT", "BUDDY", "TLSF", "NEXT_FIT"};
+
+/* Sets up 10000 live blocks of 1-256 bytes in an 8MB arena, then replaces
+ * random ones ops times, storing the time of every kfree and kalloc.
+ * Returns the number of failed kallocs. */
+static int run_mixed_pairs(enum allocation_algorithm algo, int ops, double *allocTimes, double *freeTimes){
+    const int live = 10000;
+    void **blocks = malloc(sizeof(void*) * live);
+    int failed = 0;
+
+    initialize_allocator(8 << 20, algo);
+    srand(1);
+    for (int i = 0; i < live; ++i){
+        blocks[i] = kalloc(1 + rand() % 256);
+    }
+    for (int i = 0; i < ops; ++i){
+        int victim = rand() % live;
+        int size = 1 + rand() % 256;
+        double t0 = now_ns();
+        if (blocks[victim] != NULL){
+            kfree(blocks[victim]);
+        }
+        double t1 = now_ns();
+        blocks[victim] = kalloc(size);
+        double t2 = now_ns();
+
+        failed += (blocks[victim] == NULL);
+        freeTimes[i] = t1 - t0;
+        allocTimes[i] = t2 - t1;
+    }
+    destroy_allocator();
+    free(blocks);
+    return failed;
+}
+
+static int compare_doubles(const void *a, const void *b){
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+/* buddy: random sized kalloc/kfree pairs against each algorithm, with the
+ * average and the slowest call of each kind. */
+static void bench_buddy(void){
+    const int ops = 200000;
+    double *allocTimes = malloc(sizeof(double) * ops);
+    double *freeTimes = malloc(sizeof(double) * ops);
+
+    printf("buddy: 10000 live blocks of 1-256 bytes in a 8MB arena, %d kfree/kalloc pairs\n", ops);
+    printf("%10s %12s %12s %12s %12s %10s\n", "algorithm", "ns/kalloc", "max kalloc", "ns/kfree", "max kfree", "failed");
+
+    for (int algo = FIRST_FIT; algo <= BUDDY; ++algo){
+        double allocTime = 0, freeTime = 0, allocMax = 0, freeMax = 0;
+        int failed = run_mixed_pairs((enum allocation_algorithm)algo, ops, allocTimes, freeTimes);
+
+        for (int i = 0; i < ops; ++i){
+            freeTime += freeTimes[i];
+            allocTime += allocTimes[i];
+            freeMax = (freeTimes[i] > freeMax) ? freeTimes[i] : freeMax;
+            allocMax = (allocTimes[i] > allocMax) ? allocTimes[i] : allocMax;
+        }
+        printf("%10s %12.1f %12.0f %12.1f %12.0f %10d\n", algorithmNames[algo],
+                allocTime / ops, allocMax, freeTime / ops, freeMax, failed);
+    }
+    free(allocTimes);
+    free(freeTimes);
+}
+
+/* latency: per-call latency distribution of the same workload for every
+ * algorithm. The times include the cost of reading the clock. */
+static void bench_latency(void){
+    const int ops = 200000;
+    double *allocTimes = malloc(sizeof(double) * ops);
+    double *freeTimes = malloc(sizeof(double) * ops);
+
+    printf("latency: 10000 live blocks of 1-256 bytes in a 8MB arena, %d kfree/kalloc pairs (ns)\n", ops);
+    printf("%10s %9s %9s %9s %9s %9s %9s\n", "algorithm",
+            "p50 alloc", "p99 alloc", "max alloc", "p50 free", "p99 free", "max free");
+
+    for (int algo = FIRST_FIT; algo <= TLSF; ++algo){
+        run_mixed_pairs((enum allocation_algorithm)algo, ops, allocTimes, freeTimes);
+        qsort(allocTimes, ops, sizeof(double), compare_doubles);
+        qsort(freeTimes, ops, sizeof(double), compare_doubles);
+
+        printf("%10s %9.0f %9.0f %9.0f %9.0f %9.0f %9.0f\n", algorithmNames[algo],
+                allocTimes[ops / 2], allocTimes[ops / 100 * 99], allocTimes[ops - 1],
+                freeTimes[ops / 2], freeTimes[ops / 100 * 99], freeTimes[ops - 1]);
+    }
+    free(allocTimes);
+    free(freeTimes);
+}
+
+/* next_fit: a churn of small random blocks in a tight arena under
+ * FIRST_FIT and NEXT_FIT; the statistics include the average number of
+ * free blocks each kalloc looked at. */
+static void bench_next_fit(void){
+    const enum allocation_algorithm algos[] = {FIRST_FIT, NEXT_FIT};
+    const int live = 10000;
+    const int ops = 500000;
+    void **blocks = malloc(sizeof(void*) * live);
+
+    printf("next_fit: %d live blocks of 1-64 bytes in a %dKB arena, %d kfree/kalloc pairs\n",
+            live, live * 48 / 1024, ops);
+
+    for (int a = 0; a < 2; ++a){
+        double allocTime = 0;
+
+        initialize_allocator(live * 48, algos[a]);
+        srand(1);
+        for (int i = 0; i < live; ++i){
+            blocks[i] = kalloc(1 + rand() % 64);
+        }
+        for (int i = 0; i < ops; ++i){
+            int victim = rand() % live;
+            if (blocks[victim] != NULL){
+                kfree(blocks[victim]);
+            }
+            double t0 = now_ns();
+            blocks[victim] = kalloc(1 + rand() % 64);
+            allocTime += now_ns() - t0;
+        }
+
+        printf("\n%s: %.1f ns/kalloc\n", algorithmNames[algos[a]], allocTime / ops);
+        print_statistics();
+        destroy_allocator();
+    }
+    free(blocks);
+}
+
+/* Grows numVectors buffers in turns, 16 bytes at a time up to 4KB each,
+ * with krealloc or with kalloc + memcpy + kfree. Returns the time taken. */
+static double run_vectors(enum allocation_algorithm algo, int numVectors, int useRealloc){
+    const int step = 16;
+    const int maxSize = 4096;
+    char **vectors = calloc((size_t)numVectors, sizeof(char*));
+    double start = now_ns();
+
+    /* Room for every buffer and its next copy, with slack for fragmentation */
+    initialize_allocator(numVectors * maxSize * 4, algo);
+    for (int size = step; size <= maxSize; size += step){
+        for (int v = 0; v < numVectors; ++v){
+            char *grown = NULL;
+            if (useRealloc){
+                grown = krealloc(vectors[v], size);
+            } else {
+                grown = kalloc(size);
+                if (grown != NULL && vectors[v] != NULL){
+                    memcpy(grown, vectors[v], (size_t)(size - step));
+                    kfree(vectors[v]);
+                }
+            }
+            if (grown == NULL){
+                continue;
+            }
+            vectors[v] = grown;
+            memset(vectors[v] + size - step, v, (size_t)step);
+        }
+    }
+    double elapsed = now_ns() - start;
+
+    if (useRealloc){
+        print_statistics();
+    }
+    destroy_allocator();
+    free(vectors);
+    return elapsed;
+}
+
+/* realloc: growing buffers with krealloc against moving them every time */
+static void bench_realloc(void){
+    const enum allocation_algorithm algos[] = {FIRST_FIT, TLSF, BUDDY};
+
+    for (int a = 0; a < 3; ++a){
+        for (int n = 1; n <= 100; n *= 100){
+            printf("realloc: %s, %d buffer(s) grown to 4KB in 16 byte steps\n", algorithmNames[algos[a]], n);
+            double moved = run_vectors(algos[a], n, 0);
+            double grown = run_vectors(algos[a], n, 1);
+            printf("kalloc+memcpy+kfree %.2f ms, krealloc %.2f ms\n\n", moved / 1e6, grown / 1e6);
+        }
+    }
+}
+
+/* Per-thread state for bench_threads */
+struct churnArgs {
+    struct KAllocator *ka;
+    int ops;
+    unsigned int seed;
+};
+
+static unsigned int xorshift(unsigned int *state){
+    unsigned int x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/* Each thread keeps up to 256 blocks of 16 to 255 bytes and randomly frees
+ * or allocates one of them, ops times. */
+static void* churn_thread(void *arg){
+    struct churnArgs *args = arg;
+    void *blocks[256] = {NULL};
+
+    for (int i = 0; i < args->ops; ++i){
+        int slot = xorshift(&args->seed) % 256;
+        if (blocks[slot] != NULL){
+            kfree_to(args->ka, blocks[slot]);
+            blocks[slot] = NULL;
+        } else {
+            blocks[slot] = kalloc_from(args->ka, 16 + xorshift(&args->seed) % 240);
+        }
+    }
+    for (int i = 0; i < 256; ++i){
+        if (blocks[i] != NULL){
+            kfree_to(args->ka, blocks[i]);
+        }
+    }
+    return NULL;
+}
+
+/* Runs numThreads churn threads on one allocator and returns operations per second */
+static double run_threads(int numThreads, int flags){
+    const int opsPerThread = 200000;
+    struct KAllocator *ka = kallocator_create(64 << 20, FIRST_FIT, flags);
+    pthread_t threads[16];
+    struct churnArgs args[16];
+
+    double start = now_ns();
+    for (int i = 0; i < numThreads; ++i){
+        args[i].ka = ka;
+        args[i].ops = opsPerThread;
+        args[i].seed = 12345u + (unsigned int)i * 7919u;
+        pthread_create(&threads[i], NULL, churn_thread, &args[i]);
+    }
+    for (int i = 0; i < numThreads; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed = now_ns() - start;
+
+    kallocator_destroy(ka);
+    return (double)numThreads * opsPerThread / (elapsed / 1e9);
+}
+
+/* Allocates rounds of batchSize 32 byte records, as when building a list or
+ * a tree, and frees each round again once the next one is in place. With
+ * useBatch the records come from kalloc_batch and go back through
+ * kfree_batch; otherwise one kalloc and one kfree per record. */
+static void run_batches(enum allocation_algorithm algo, int flags, int useBatch, double *allocNs, double *freeNs){
+    const int batchSize = 64;
+    const int rounds = 5000;
+    const int recordSize = 32;
+    void *current[64];
+    void *previous[64];
+    int havePrevious = 0;
+    double allocTime = 0;
+    double freeTime = 0;
+
+    initialize_allocator_flags(batchSize * 2 * 64 * 4, algo, flags);
+    for (int round = 0; round < rounds; ++round){
+        double t0 = now_ns();
+        if (useBatch){
+            if (kalloc_batch(recordSize, batchSize, current) != batchSize){
+                break;
+            }
+        } else {
+            for (int i = 0; i < batchSize; ++i){
+                current[i] = kalloc(recordSize);
+            }
+        }
+        double t1 = now_ns();
+        for (int i = 0; i < batchSize; ++i){
+            memset(current[i], round, (size_t)recordSize);
+        }
+
+        double t2 = now_ns();
+        if (havePrevious && useBatch){
+            kfree_batch(previous, batchSize);
+        } else if (havePrevious){
+            for (int i = 0; i < batchSize; ++i){
+                kfree(previous[i]);
+            }
+        }
+        double t3 = now_ns();
+
+        allocTime += t1 - t0;
+        freeTime += t3 - t2;
+        memcpy(previous, current, sizeof(current));
+        havePrevious = 1;
+    }
+
+    *allocNs = allocTime / rounds;
+    *freeNs = freeTime / rounds;
+    destroy_allocator();
+}
+
+/* batch: kalloc_batch/kfree_batch against one call per record. */
+static void bench_batch(void){
+    const enum allocation_algorithm algos[] = {FIRST_FIT, BEST_FIT, TLSF, BUDDY};
+    const int flagSets[] = {0, KALLOC_BOUNDARY_TAGS};
+
+    for (int a = 0; a < 4; ++a){
+        for (int f = 0; f < 2; ++f){
+            double singleAlloc, singleFree, batchAlloc, batchFree;
+            if (algos[a] == BUDDY && f > 0){
+                continue;
+            }
+            run_batches(algos[a], flagSets[f], 0, &singleAlloc, &singleFree);
+            run_batches(algos[a], flagSets[f], 1, &batchAlloc, &batchFree);
+            printf("batch: %s%s, 64 records of 32 bytes\n", algorithmNames[algos[a]], flagSets[f] ? " with boundary tags" : "");
+            printf("one at a time: alloc %.0f ns, free %.0f ns per round\n", singleAlloc, singleFree);
+            printf("batched:       alloc %.0f ns, free %.0f ns per round\n\n", batchAlloc, batchFree);
+        }
+    }
+}
+
+/* Builds a heap of numBlocks random 16 to 256 byte blocks and frees every
+ * other one, leaving as many holes. */
+static void **fragment_heap(enum allocation_algorithm algo, int numBlocks){
+    void **blocks = malloc(sizeof(void*) * (size_t)numBlocks);
+
+    initialize_allocator(numBlocks * 300, algo);
+    srand(1);
+    for (int i = 0; i < numBlocks; ++i){
+        blocks[i] = kalloc(16 + rand() % 241);
+    }
+    for (int i = 0; i < numBlocks; i += 2){
+        kfree(blocks[i]);
+    }
+    return blocks;
+}
+
+/* compact_step: the pause of compact_allocation against the longest pause
+ * of compact_step with a 4KB budget, over the same heap. */
+static void bench_compact_step(void){
+    const enum allocation_algorithm algos[] = {FIRST_FIT, TLSF};
+    const int numBlocks = 20000;
+    void **before = malloc(sizeof(void*) * (size_t)numBlocks);
+    void **after = malloc(sizeof(void*) * (size_t)numBlocks);
+
+    for (int a = 0; a < 2; ++a){
+        void **blocks = fragment_heap(algos[a], numBlocks);
+        double t0 = now_ns();
+        int moves = compact_allocation(before, after);
+        double full = now_ns() - t0;
+        destroy_allocator();
+        free(blocks);
+
+        blocks = fragment_heap(algos[a], numBlocks);
+        double longest = 0;
+        double total = 0;
+        int steps = 0;
+        int stepMoves = 0;
+        int done = 0;
+        while (!done){
+            t0 = now_ns();
+            stepMoves += compact_step(4096, before, after, &done);
+            double pause = now_ns() - t0;
+            total += pause;
+            longest = (pause > longest) ? pause : longest;
+            ++steps;
+        }
+        destroy_allocator();
+        free(blocks);
+
+        printf("compact_step: %s, %d blocks with a hole after each\n", algorithmNames[algos[a]], numBlocks / 2);
+        printf("compact_allocation: %d moves in %.0f us\n", moves, full / 1e3);
+        printf("compact_step(4096): %d moves in %d steps, %.0f us in all, longest step %.1f us\n\n",
+            stepMoves, steps, total / 1e3, longest / 1e3);
+    }
+    free(before);
+    free(after);
+}
+
+/* reloc: fixing up every held pointer after compaction, by searching the
+ * before/after arrays and by kreloc_lookup. */
+static void bench_reloc(void){
+    const int numBlocks = 20000;
+    void **before = malloc(sizeof(void*) * (size_t)numBlocks);
+    void **after = malloc(sizeof(void*) * (size_t)numBlocks);
+
+    void **blocks = fragment_heap(FIRST_FIT, numBlocks);
+    double t0 = now_ns();
+    int moves = compact_allocation(before, after);
+    for (int i = 1; i < numBlocks; i += 2){
+        for (int j = 0; j < moves; ++j){
+            if (blocks[i] == before[j]){
+                blocks[i] = after[j];
+                break;
+            }
+        }
+    }
+    double linear = now_ns() - t0;
+    destroy_allocator();
+    free(blocks);
+
+    blocks = fragment_heap(FIRST_FIT, numBlocks);
+    t0 = now_ns();
+    struct krelocMap *map = compact_allocation_map();
+    for (int i = 1; i < numBlocks; i += 2){
+        blocks[i] = kreloc_lookup(map, blocks[i]);
+    }
+    double mapped = now_ns() - t0;
+    kreloc_free(map);
+    destroy_allocator();
+    free(blocks);
+
+    printf("reloc: %d blocks moved, every pointer fixed up\n", moves);
+    printf("before/after search: %.2f ms, kreloc_lookup: %.2f ms\n", linear / 1e6, mapped / 1e6);
+    free(before);
+    free(after);
+}
+
+/* Churns handles to 16 to 256 byte blocks, writing each new block while
+ * pinned, and records the time of every operation. With background set
+ * the compactor runs; otherwise the serving thread compacts every
+ * compactEvery operations itself. */
+static void run_compactor(int background, int compactEvery, double *times, int ops){
+    const int slots = 4000;
+    int *handles = calloc((size_t)slots, sizeof(int));
+    void **before = malloc(sizeof(void*) * (size_t)slots);
+    void **after = malloc(sizeof(void*) * (size_t)slots);
+
+    initialize_allocator(slots * 300, FIRST_FIT);
+    if (background){
+        start_compactor(0.5, NULL, NULL);
+    }
+    srand(1);
+    for (int i = 0; i < ops; ++i){
+        int slot = rand() % slots;
+        int size = 16 + rand() % 241;
+        double t0 = now_ns();
+        if (handles[slot] != 0){
+            khandle_free(handles[slot]);
+            handles[slot] = 0;
+        } else {
+            handles[slot] = khandle_alloc(size);
+            if (handles[slot] != 0){
+                kalloc_pin();
+                memset(khandle_deref(handles[slot]), slot, (size_t)size);
+                kalloc_unpin();
+            }
+        }
+        if (!background && i % compactEvery == compactEvery - 1){
+            compact_allocation(before, after);
+        }
+        times[i] = now_ns() - t0;
+    }
+    if (background){
+        stop_compactor();
+    }
+    destroy_allocator();
+    free(handles);
+    free(before);
+    free(after);
+}
+
+/* compactor: operation latency with compaction on the serving thread and
+ * with the background compactor. */
+static void bench_compactor(void){
+    const int ops = 200000;
+    double *times = malloc(sizeof(double) * (size_t)ops);
+
+    for (int background = 0; background <= 1; ++background){
+        run_compactor(background, 20000, times, ops);
+        qsort(times, (size_t)ops, sizeof(double), compare_doubles);
+        printf("compactor: %s, %d handle operations\n",
+                background ? "background compactor" : "compact_allocation every 20000 operations", ops);
+        printf("p50 %.0f ns, p99 %.0f ns, p99.99 %.0f ns, max %.0f us\n\n",
+                times[ops / 2], times[ops / 100 * 99], times[ops / 10000 * 9999], times[ops - 1] / 1e3);
+    }
+    free(times);
+}
+
+/* Resident set size of this process, from /proc/self/statm */
+static double resident_mb(void){
+    long size = 0;
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+
+    if (statm != NULL){
+        if (fscanf(statm, "%ld %ld", &size, &pages) != 2){
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    return (double)pages * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+/* pages: resident memory as a heap of 1KB blocks is filled, mostly freed,
+ * and compacted. */
+static void bench_pages(void){
+    const int numBlocks = 60000;
+    void **blocks = malloc(sizeof(void*) * (size_t)numBlocks);
+    void **before = malloc(sizeof(void*) * (size_t)numBlocks);
+    void **after = malloc(sizeof(void*) * (size_t)numBlocks);
+    double base = resident_mb();
+
+    initialize_allocator(numBlocks * 1100, FIRST_FIT);
+    for (int i = 0; i < numBlocks; ++i){
+        blocks[i] = kalloc(1024);
+        memset(blocks[i], i, 1024);
+    }
+    double full = resident_mb() - base;
+    for (int i = 0; i < numBlocks; ++i){
+        if (i % 10 != 0){
+            kfree(blocks[i]);
+        }
+    }
+    double freed = resident_mb() - base;
+    compact_allocation(before, after);
+    double compacted = resident_mb() - base;
+    print_statistics();
+    destroy_allocator();
+
+    printf("pages: %d blocks of 1KB, 9 in 10 then freed\n", numBlocks);
+    printf("resident: %.1f MB full, %.1f MB after the frees, %.1f MB after compaction\n", full, freed, compacted);
+    free(blocks);
+    free(before);
+    free(after);
+}
+
+/* Memory of this process backed by transparent huge pages, from
+ * /proc/self/smaps_rollup */
+static double huge_mb(void){
+    char line[256];
+    long kb = 0;
+    FILE *smaps = fopen("/proc/self/smaps_rollup", "r");
+
+    if (smaps != NULL){
+        while (fgets(line, sizeof(line), smaps) != NULL){
+            if (sscanf(line, "AnonHugePages: %ld", &kb) == 1){
+                break;
+            }
+        }
+        fclose(smaps);
+    }
+    return (double)kb / 1024.0;
+}
+
+/* Fills a 256MB arena with 4KB blocks and reads 8 bytes at a time from
+ * random blocks, returning the reads per second. */
+static double run_hugepages(int flags, double *hugeMb){
+    const int blockSize = 4096;
+    const int numBlocks = 64 * 1024;
+    const int reads = 20000000;
+    void **blocks = malloc(sizeof(void*) * (size_t)numBlocks);
+    unsigned int x = 1;
+    long sum = 0;
+
+    initialize_allocator_flags(numBlocks * (blockSize + 64), FIRST_FIT, flags);
+    for (int i = 0; i < numBlocks; ++i){
+        blocks[i] = kalloc(blockSize);
+        memset(blocks[i], i, blockSize);
+    }
+    *hugeMb = huge_mb();
+
+    double t0 = now_ns();
+    for (int i = 0; i < reads; ++i){
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        sum += *(long*)((char*)blocks[x % numBlocks] + (x >> 16) % (blockSize / 8) * 8);
+    }
+    double elapsed = now_ns() - t0;
+
+    destroy_allocator();
+    free(blocks);
+    /* Keep the reads from being optimised away */
+    if (sum == 42){
+        printf("\n");
+    }
+    return reads / (elapsed / 1e9);
+}
+
+/* hugepages: random reads across a 256MB heap, with normal pages and with
+ * KALLOC_HUGE_PAGES. */
+static void bench_hugepages(void){
+    printf("hugepages: random 8 byte reads from 64K blocks of 4KB, FIRST_FIT\n");
+    printf("%14s %14s %14s\n", "pages", "Mreads/s", "THP MB");
+
+    for (int huge = 0; huge <= 1; ++huge){
+        double hugeMb = 0;
+        double rate = run_hugepages(huge ? KALLOC_HUGE_PAGES : 0, &hugeMb);
+        printf("%14s %14.1f %14.1f\n", huge ? "huge" : "normal", rate / 1e6, hugeMb);
+    }
+}
+
+/* restart: a file-backed heap of 64MB, with 1 million live blocks, built
+ * from scratch and then reattached from its file. */
+static void bench_restart(void){
+    const char *path = "kbench.heap";
+    const int numBlocks = 1000000;
+    const int size = 64 << 20;
+
+    unlink(path);
+    double t0 = now_ns();
+    initialize_allocator_file(path, size, FIRST_FIT, 0);
+    long *root = kalloc(sizeof(long));
+    for (int i = 0; i < numBlocks; ++i){
+        kalloc(16 + i % 32);
+    }
+    *root = numBlocks;
+    kalloc_set_root(root);
+    double built = now_ns() - t0;
+    destroy_allocator();
+
+    t0 = now_ns();
+    int reattached = initialize_allocator_file(path, size, FIRST_FIT, 0);
+    double attached = now_ns() - t0;
+    root = kalloc_root();
+
+    printf("restart: %d blocks in a 64MB file-backed arena, FIRST_FIT\n", numBlocks);
+    printf("built from scratch in %.1f ms, reattached in %.1f ms (%s, root says %ld blocks)\n",
+            built / 1e6, attached / 1e6, (reattached == 2) ? "ok" : "failed", (root != NULL) ? *root : 0L);
+    if (reattached){
+        destroy_allocator();
+    }
+    unlink(path);
+}
+
+/* stats: the time a call to get_stats and to available_memory takes with
+ * more and more live blocks, every other one freed. */
+static void bench_stats(void){
+    const int calls = 100000;
+
+    printf("stats: ns per call, 64MB arena, FIRST_FIT\n");
+    printf("%14s %14s %18s\n", "live blocks", "get_stats", "available_memory");
+
+    for (int numBlocks = 1000; numBlocks <= 1000000; numBlocks *= 10){
+        initialize_allocator(64 << 20, FIRST_FIT);
+        void **ptrs = malloc(numBlocks * sizeof(void*));
+        for (int i = 0; i < numBlocks; ++i){
+            ptrs[i] = kalloc(16 + i % 32);
+        }
+        for (int i = 0; i < numBlocks; i += 2){
+            kfree(ptrs[i]);
+        }
+
+        double t0 = now_ns();
+        for (int i = 0; i < calls; ++i){
+            get_stats();
+        }
+        double statsNs = (now_ns() - t0) / calls;
+        t0 = now_ns();
+        for (int i = 0; i < calls; ++i){
+            available_memory();
+        }
+        double availableNs = (now_ns() - t0) / calls;
+
+        printf("%14d %14.1f %18.1f\n", numBlocks - numBlocks / 2, statsNs, availableNs);
+        free(ptrs);
+        destroy_allocator();
+    }
+}
+
+/* threads: kalloc/kfree throughput with 1 to 16 threads sharing one
+ * allocator, with a single region and with one region per thread. */
+static void bench_threads(void){
+    printf("threads: total kalloc+kfree throughput (Mops/s), 64MB arena, FIRST_FIT\n");
+    printf("%10s %14s %14s\n", "threads", "1 region", "16 regions");
+
+    for (int n = 1; n <= 16; n *= 2){
+        double single = run_threads(n, 0);
+        double regions = run_threads(n, KALLOC_REGIONS(16));
+        printf("%10d %14.2f %14.2f\n", n, single / 1e6, regions / 1e6);
+    }
+}
+
+/* thread_cache: the same workload with per-thread caches in front of the
+ * regions, against plain regions. */
+static void bench_thread_cache(void){
+    printf("thread_cache: total kalloc+kfree throughput (Mops/s), 64MB arena, FIRST_FIT\n");
+    printf("%10s %14s %14s %14s\n", "threads", "16 regions", "cache", "cache+16 reg");
+
+    for (int n = 1; n <= 16; n *= 2){
+        double regions = run_threads(n, KALLOC_REGIONS(16));
+        double cached = run_threads(n, KALLOC_THREAD_CACHE);
+        double both = run_threads(n, KALLOC_THREAD_CACHE | KALLOC_REGIONS(16));
+        printf("%10d %14.2f %14.2f %14.2f\n", n, regions / 1e6, cached / 1e6, both / 1e6);
+    }
+}
+
+
+struct benchmark {
+    const char *name;
+    void (*run)(void);
+};
+
+static const struct benchmark benchmarks[] = {
+    {"free_chunks", bench_free_chunks},
+    {"live_objects", bench_live_objects},
+    {"boundary_tags", bench_boundary_tags},
+    {"metadata", bench_metadata},
+    {"buddy", bench_buddy},
+    {"latency", bench_latency},
+    {"next_fit", bench_next_fit},
+    {"realloc", bench_realloc},
+    {"threads", bench_threads},
+    {"thread_cache", bench_thread_cache},
+    {"batch", bench_batch},
+    {"compact_step", bench_compact_step},
+    {"reloc", bench_reloc},
+    {"compactor", bench_compactor},
+    {"pages", bench_pages},
+    {"hugepages", bench_hugepages},
+    {"restart", bench_restart},
+    {"stats", bench_stats},
+};
+
+int main(int argc, char* argv[]) {
+    int numBenchmarks = sizeof(benchmarks) / sizeof(benchmarks[0]);
+    int ran = 0;
+
+    for (int i = 0; i < numBenchmarks; ++i){
+        if (argc < 2 || strcmp(argv[1], benchmarks[i].name) == 0){
+            benchmarks[i].run();
+            printf("\n");
+            ++ran;
+        }
+    }
+
+    if (ran == 0){
+        printf("Unknown benchmark %s. Available:\n", argv[1]);
+        for (int i = 0; i < numBenchmarks; ++i){
+            printf("  %s\n", benchmarks[i].name);
+        }
+        return 1;
+    }
+    return 0;
+}
@@ -11,6 +11,8 @@ bool ragMutexIsInit = false;
     so, quite sparse. Thus, we will condense them into a specialized linked list. */
 static struct nodeStruct* resources = NULL;
 static struct nodeStruct* threads = NULL;
+/* Both lists take their nodes from ragPool, which is released in cleanup(). */
+static struct nodePool ragPool = NODE_POOL_INITIALIZER(sizeof(struct nodeStruct));
 /* This will will act as global trackers for which lock we're working with */
 static int num_smartlocks = 0;
 
@@ -46,7 +48,7 @@ void init_lock(SmartLock* lock) {
         
         ////printf("DEBUG: init | init lock with id = %d\n", num_smartlocks);
 
-        struct nodeStruct *resourceNode = List_createNode(num_smartlocks);
+        struct nodeStruct *resourceNode = List_createNode(&ragPool, num_smartlocks);
         if (ragMutexIsInit == false){
             pthread_mutex_init(&ragMutex, NULL);
         }
@@ -56,7 +58,7 @@ void init_lock(SmartLock* lock) {
         if (List_findNode(threads, threadID) == NULL){
             /* If the node DOESN'T exist, create it. (the resource node is guaranteed
              * not to exist, because we just incremented num_smartlocks) */
-            struct nodeStruct *threadNode = List_createNode(threadID);
+            struct nodeStruct *threadNode = List_createNode(&ragPool, threadID);
             List_insertTail(&threads, threadNode);
         } 
     }
@@ -82,7 +84,7 @@ int lock(SmartLock* lock) {
         threadNode = List_findNode( threads, threadID );
         if (threadNode == NULL){
             /* If the node DOESN'T exist, create it. */
-            threadNode = List_createNode( threadID );
+            threadNode = List_createNode( &ragPool, threadID );
             List_insertTail( &threads, threadNode );
         } 
     }
@@ -175,8 +177,9 @@ void cleanup() {
 
     pthread_mutex_lock( &ragMutex );
     {
-        if (resources != NULL){  List_deleteAll(&resources); }
-        if (threads != NULL){    List_deleteAll(&threads);   }
+        if (resources != NULL){  List_deleteAll(&ragPool, &resources); }
+        if (threads != NULL){    List_deleteAll(&ragPool, &threads);   }
+        Pool_destroy(&ragPool);
     }
     pthread_mutex_unlock( &ragMutex );
 }
@@ -9,12 +9,13 @@ static void swapElements(struct nodeStruct **previous, struct nodeStruct *nodeA,
 
 
 /*
- * Allocate memory for a node of type struct nodeStruct and initialize
+ * Take a node of type struct nodeStruct from pool and initialize
  * it with the value id. Return a pointer to the new node.
+ * The pool must hold nodes of sizeof(struct nodeStruct) bytes.
  */
-struct nodeStruct* List_createNode(int id)
+struct nodeStruct* List_createNode(struct nodePool *pool, int id)
 {
-	struct nodeStruct *pNode = malloc(sizeof(struct nodeStruct));
+	struct nodeStruct *pNode = Pool_alloc(pool);
 	if (pNode != NULL) {
 		pNode->id = id;
         pNode->edge_to = NULL;
@@ -83,12 +84,12 @@ struct nodeStruct* List_findNode(struct nodeStruct *head, int id)
 }
 
 /*
- * Delete node from the list and free memory allocated to it.
+ * Delete node from the list and return it to pool.
  * This function assumes that node has been properly set (by for example
  * calling List_findNode()) to a valid node in the list. If the list contains
  * only node, the head of the list should be set to NULL.
  */
-void List_deleteNode (struct nodeStruct **headRef, struct nodeStruct *node)
+void List_deleteNode (struct nodePool *pool, struct nodeStruct **headRef, struct nodeStruct *node)
 {
 	assert(headRef != NULL);
 	assert(*headRef != NULL);
@@ -111,7 +112,7 @@ void List_deleteNode (struct nodeStruct **headRef, struct nodeStruct *node)
 	}
 
 	// Free memory:
-	free(node);
+	Pool_free(pool, node);
 }
 
 
@@ -186,7 +187,7 @@ int List_findCycle(struct nodeStruct *node){
     return 0;
 }
 
-void List_deleteAll(struct nodeStruct **headRef){
+void List_deleteAll(struct nodePool *pool, struct nodeStruct **headRef){
     if (headRef == NULL){
         printf("List_deleteAll called with a NULL headRef\n");
         return;
@@ -199,7 +200,7 @@ void List_deleteAll(struct nodeStruct **headRef){
 
     while (node != NULL){
         *headRef = node->next;
-        free(node);
+        Pool_free(pool, node);
 
         node = *headRef;
     }
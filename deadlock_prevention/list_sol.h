@@ -3,6 +3,8 @@
 #ifndef LIST_H_
 #define LIST_H_
 
+#include "node_pool.h"
+
 struct nodeStruct {
     int id;
     struct nodeStruct *edge_to;
@@ -10,10 +12,11 @@ struct nodeStruct {
 };
 
 /*
- * Allocate memory for a node of type struct nodeStruct and initialize
+ * Take a node of type struct nodeStruct from pool and initialize
  * it with the value item. Return a pointer to the new node.
+ * The pool must hold nodes of sizeof(struct nodeStruct) bytes.
  */
-struct nodeStruct* List_createNode(int id);
+struct nodeStruct* List_createNode(struct nodePool *pool, int id);
 
 /*
  * Insert node at the head of the list.
@@ -37,12 +40,12 @@ int List_countNodes (struct nodeStruct *head);
 struct nodeStruct* List_findNode(struct nodeStruct *head, int item);
 
 /*
- * Delete node from the list and free memory allocated to it.
+ * Delete node from the list and return it to pool.
  * This function assumes that node has been properly set (by for example
  * calling List_findNode()) to a valid node in the list. If the list contains
  * only node, the head of the list should be set to NULL.
  */
-void List_deleteNode (struct nodeStruct **headRef, struct nodeStruct *node);
+void List_deleteNode (struct nodePool *pool, struct nodeStruct **headRef, struct nodeStruct *node);
 
 /*
  * Sort the list in ascending order based on the item field.
@@ -57,7 +60,7 @@ void List_setEdge(struct nodeStruct *node, struct nodeStruct *edge_to);
 /* findCycle only finds a cycle if node is in the cycle. */
 int List_findCycle(struct nodeStruct *node);
 
-void List_deleteAll(struct nodeStruct **headRef);
+void List_deleteAll(struct nodePool *pool, struct nodeStruct **headRef);
 
 
 #endif
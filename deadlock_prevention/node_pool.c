@@ -0,0 +1,120 @@
+#include "node_pool.h"
+#include <stdlib.h>
+#include <assert.h>
+
+/* Slabs are linked through a header placed in front of their nodes */
+struct poolSlab {
+    struct poolSlab *next;
+};
+
+/* A free node holds the link to the next free node */
+struct poolFreeNode {
+    struct poolFreeNode *next;
+};
+
+/* Nodes are kept at this alignment, which suits any struct of pointers and ints */
+#define POOL_ALIGNMENT 16
+
+static size_t roundUp(size_t value, size_t multiple);
+static int addSlab(struct nodePool *pool);
+
+
+/*
+ * Initialize an empty pool of nodes of nodeSize bytes.
+ */
+void Pool_init (struct nodePool *pool, size_t nodeSize)
+{
+    pool->nodeSize = nodeSize;
+    pool->nodesPerSlab = POOL_FIRST_SLAB_NODES;
+    pool->slabs = NULL;
+    pool->freeNodes = NULL;
+    pool->slabBytes = 0;
+    pool->nodesInUse = 0;
+    pool->mallocCalls = 0;
+}
+
+/*
+ * Return an uninitialized node, or NULL if a new slab was needed and
+ * malloc failed.
+ */
+void* Pool_alloc (struct nodePool *pool)
+{
+    if (pool->freeNodes == NULL && !addSlab(pool)) {
+        return NULL;
+    }
+
+    struct poolFreeNode *node = pool->freeNodes;
+    pool->freeNodes = node->next;
+    ++pool->nodesInUse;
+    return node;
+}
+
+/*
+ * Return node, which must have come from this pool, to the pool.
+ */
+void Pool_free (struct nodePool *pool, void *node)
+{
+    struct poolFreeNode *freeNode = node;
+
+    assert(pool->nodesInUse > 0);
+    freeNode->next = pool->freeNodes;
+    pool->freeNodes = freeNode;
+    --pool->nodesInUse;
+}
+
+/*
+ * Free every slab, and with them every node handed out by the pool.
+ * The pool is left empty and can be used again.
+ */
+void Pool_destroy (struct nodePool *pool)
+{
+    struct poolSlab *slab = pool->slabs;
+
+    while (slab != NULL) {
+        struct poolSlab *next = slab->next;
+        free(slab);
+        slab = next;
+    }
+
+    /* Keep the counter of malloc calls, it is cumulative */
+    long mallocCalls = pool->mallocCalls;
+    Pool_init(pool, pool->nodeSize);
+    pool->mallocCalls = mallocCalls;
+}
+
+
+static size_t roundUp(size_t value, size_t multiple)
+{
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+/* Allocates the next slab and threads all of its nodes onto the free list */
+static int addSlab(struct nodePool *pool)
+{
+    size_t stride = roundUp(pool->nodeSize < sizeof(struct poolFreeNode) ? sizeof(struct poolFreeNode) : pool->nodeSize, POOL_ALIGNMENT);
+    size_t header = roundUp(sizeof(struct poolSlab), POOL_ALIGNMENT);
+    size_t bytes = header + stride * (size_t)pool->nodesPerSlab;
+
+    struct poolSlab *slab = malloc(bytes);
+    if (slab == NULL) {
+        return 0;
+    }
+    ++pool->mallocCalls;
+    pool->slabBytes += bytes;
+
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    /* Thread back to front, so nodes are handed out in address order */
+    char *nodes = (char*)slab + header;
+    for (int i = pool->nodesPerSlab - 1; i >= 0; --i) {
+        struct poolFreeNode *node = (struct poolFreeNode*)(nodes + stride * (size_t)i);
+        node->next = pool->freeNodes;
+        pool->freeNodes = node;
+    }
+
+    if (pool->nodesPerSlab < POOL_MAX_SLAB_NODES) {
+        pool->nodesPerSlab *= 2;
+    }
+    return 1;
+}
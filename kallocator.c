@@ -1,257 +1,3360 @@
 #include <assert.h>
 #include <string.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "kallocator.h"
 #include "list_sol.h"
+#include "addr_tree.h"
+#include "node_index.h"
+
+/* One size class per power of two that fits in an int. */
+#define NUM_SIZE_CLASSES 32
+
+/* With KALLOC_BOUNDARY_TAGS every block, free or allocated, starts with a
+ * header tag and ends with an identical footer tag holding
+ * (block size << 1) | free. A free block is at least a header and footer. */
+#define TAG_SIZE ((int)sizeof(unsigned int))
+#define MIN_TAGGED_BLOCK (2 * TAG_SIZE)
+
+/* The arena starts on a page, and regions on a page (or, when they are
+ * smaller than that, a cache line) */
+#define ARENA_ALIGN 4096
+#define REGION_ALIGN_SMALL 64
+
+/* In BUDDY mode blocks are 2^k bytes, k >= BUDDY_MIN_ORDER, and start at an
+ * offset from their region's start that is a multiple of 2^k. */
+#define BUDDY_MIN_ORDER 4
+#define BUDDY_MAX_ORDER 30
+
+/* Every size class is split into TLSF_SL_COUNT equal ranges */
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+
+/* With KALLOC_THREAD_CACHE, bin b of a thread cache holds blocks that can
+ * hold at least (b + 1) * CACHE_BIN_SIZE bytes. A bin is refilled and
+ * drained CACHE_BATCH blocks at a time, and never holds more than
+ * CACHE_BIN_LIMIT blocks; a cache never holds more than CACHE_BYTE_LIMIT. */
+#define CACHE_BIN_SIZE 16
+#define CACHE_BINS 16
+#define CACHE_MAX_SIZE (CACHE_BIN_SIZE * CACHE_BINS)
+#define CACHE_BIN_LIMIT 64
+#define CACHE_BATCH 16
+#define CACHE_BYTE_LIMIT (64 * 1024)
+
+/* The background compactor wakes up every COMPACTOR_INTERVAL_MS to look
+ * at the arena, and compacts in steps of COMPACTOR_STEP_BYTES. */
+#define COMPACTOR_INTERVAL_MS 10
+#define COMPACTOR_STEP_BYTES (16 * 1024)
+
+/* Once a free block reaches PAGE_RELEASE_MIN bytes, the whole pages in it
+ * are handed back to the OS as they become free */
+#define PAGE_RELEASE_MIN (64 * 1024)
+
+/* With KALLOC_HUGE_PAGES the arena is placed on, and memory is committed
+ * and released in, transparent huge pages of HUGE_PAGE_SIZE bytes */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define THP_ENABLED_PATH "/sys/kernel/mm/transparent_hugepage/enabled"
+
+/* A file-backed arena's file starts with a persistHeader, padded out to
+ * ARENA_ALIGN bytes, and the arena follows it. */
+#define PERSIST_MAGIC "KALLOCv1"
+#define PERSIST_VERSION 1
+/* The handle field of the root block's node */
+#define ROOT_HANDLE (-1)
+
+/* The running totals in a region are written under its lock, but
+ * kallocator_get_stats reads them without it, so both sides go through
+ * these */
+#define STAT_READ(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STAT_WRITE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+/* Whether ka is recording a trace; checked without traceLock, so that
+ * calls cost no more than this while it is not */
+#define TRACING(ka) __atomic_load_n(&(ka)->tracing, __ATOMIC_RELAXED)
+
+/* The arena is split into one or more regions (see KALLOC_REGIONS), each a
+ * contiguous slice with its own lists and its own lock, so that threads
+ * working in different regions never wait for each other. A block never
+ * spans two regions. */
+struct KRegion {
+    struct KAllocator *owner;
+    pthread_mutex_t lock;
+    int size;
+    void* memory;
+    // Some other data members you want, 
+    // such as lists to record allocated/free memory
+
+    /* freeBlocks is kept in address order at all times; freeTree indexes
+     * the same nodes by address so a freed block can be placed in O(log n).
+     * With boundary tags, freeBlocks is unordered, freeTree is unused and
+     * freeIndex maps the start of every free block to its node instead.
+     * BUDDY mode uses freeIndex the same way, to find a block's buddy. */
+    struct nodeStruct *freeBlocks;
+    struct nodeStruct *freeTree;
+    struct nodeIndex freeIndex;
+    struct nodeStruct *allocatedBlocks;
+    /* Maps the address of every allocated block to its node, for kfree. */
+    struct nodeIndex allocatedIndex;
+
+    /* Every node on the lists above comes from here */
+    struct nodePool nodePool;
+
+    /* Every node on freeBlocks is also filed under a size class, the
+     * blocks with 2^c <= size < 2^(c+1), and within it under one of
+     * TLSF_SL_COUNT equal ranges: rangeLists[c][s] runs from the smallest
+     * block of range s to the largest, rangeTails[c][s]. Bit s of
+     * rangeBitmaps[c] is set iff rangeLists[c][s] is non-empty, and bit c
+     * of classBitmap iff any range of class c is. */
+    struct nodeStruct *rangeLists[NUM_SIZE_CLASSES][TLSF_SL_COUNT];
+    struct nodeStruct *rangeTails[NUM_SIZE_CLASSES][TLSF_SL_COUNT];
+    unsigned int rangeBitmaps[NUM_SIZE_CLASSES];
+    unsigned int classBitmap;
+
+    /* NEXT_FIT's cursor: the free block its last search stopped at, or
+     * NULL to start from the head of freeBlocks. */
+    struct nodeStruct *rover;
+
+    /* Where the next compact_step carries on from: every block below it
+     * has been moved as far down as it can go. It is always the start of
+     * a block (or the end of the region). */
+    void *compactCursor;
+
+    /* Calls to kfree, and the number of free blocks looked at by
+     * kalloc, reported by print_statistics */
+    long long freeCalls;
+    long long searches;
+    long long searchSteps;
+
+    /* Blocks given back to the free blocks, and the number of blocks
+     * (tree nodes or tags) looked at to find their neighbours */
+    long long merges;
+    long long mergeSteps;
+
+    /* krealloc calls that resized a block of this region where it was,
+     * and that had to move it */
+    long long reallocsInPlace;
+    long long reallocsMoved;
+
+    /* Blocks moved by compaction, and the bytes copied to move them */
+    long long compactMoves;
+    long long compactBytes;
+
+    /* Blocks handed out, for the compactor to tell when it is idle */
+    long long allocCalls;
+
+    /* Pages handed back to the OS by release_pages */
+    long long pagesReleased;
+
+    /* Running totals, kept up to date as blocks come and go so that no
+     * statistic needs a walk: the free blocks (those filed under the size
+     * classes), the largest and smallest of them, and the allocated
+     * blocks, by the size they were asked for and by the bytes they take
+     * up. */
+    int freeBytes;
+    int freeChunks;
+    int largestFree;
+    int smallestFree;
+    int allocatedBytes;
+    int allocatedChunks;
+    int allocatedExtent;
+};
+
+/* One thread's cache for one allocator. lock is only ever contended while
+ * another thread drains every cache (for compaction, or statistics). */
+struct threadCache {
+    struct KAllocator *owner;
+    pthread_mutex_t lock;
+    void *bins[CACHE_BINS][CACHE_BIN_LIMIT];
+    int counts[CACHE_BINS];
+    long bytes;
+    long long hits;
+    long long misses;
+    struct threadCache *next;
+};
+
+/* What kallocator_compact_map returns: the blocks it moved, in increasing
+ * order of their old address, with the size each was asked for. */
+struct krelocMap {
+    int count;
+    void **before;
+    void **after;
+    int *sizes;
+};
+
+struct handleEntry {
+    void *ptr;
+    int nextFree;
+};
+
+/* Everything in a file-backed arena besides its boundary tags, which only
+ * hold sizes, so the file can be mapped at any address. checksum covers
+ * the fields before root, which never change; root is the offset of the
+ * root block's payload in the arena, or -1, and is checked against the
+ * heap on reattach instead. */
+struct persistHeader {
+    char magic[8];
+    int version;
+    int size;
+    int aalgorithm;
+    int flags;
+    int alignment;
+    int numRegions;
+    int regionSize;
+    unsigned int checksum;
+    long long root;
+};
 
 struct KAllocator {
     enum allocation_algorithm aalgorithm;
+    int flags;
+    /* The arena is size bytes of address space at memory, of which the
+     * first committed bytes are backed. A growable arena starts with less
+     * committed than size, and the last region grows into the rest;
+     * committed is guarded by that region's lock. reserved is size
+     * rounded up to whole pages. Memory is committed, and free memory
+     * handed back to the OS, in whole pageUnits: pageSize, or
+     * HUGE_PAGE_SIZE when hugePages says the OS took KALLOC_HUGE_PAGES. */
+    int size;
+    void* memory;
+    int growable;
+    long committed;
+    size_t reserved;
+    long pageSize;
+    long pageUnit;
+    int hugePages;
+    /* The header of a file-backed arena's file, mapped right before
+     * memory, or NULL; reattached is set if the file held a heap already */
+    struct persistHeader *persist;
+    int reattached;
+    /* Every block starts (with tags, every payload starts) on a multiple
+     * of alignment, and every block's extent is a multiple of it. */
+    int alignment;
+
+    /* Every region but the last is regionSize bytes; the last one also
+     * takes the remainder. */
+    int numRegions;
+    int regionSize;
+    struct KRegion *regions;
+
+    /* With KALLOC_THREAD_CACHE: every thread's cache, reachable through
+     * cacheKey from its own thread and through caches from any thread.
+     * cacheListLock is taken before any cache's lock, which is taken
+     * before any region's lock. retiredHits/retiredMisses keep the
+     * counters of caches whose thread has exited. */
+    pthread_key_t cacheKey;
+    pthread_mutex_t cacheListLock;
+    struct threadCache *caches;
+    long long retiredHits;
+    long long retiredMisses;
+
+    /* The region compact_step is working through */
+    int compactRegion;
+
+    /* The handle table: handles[h].ptr is the block handle h refers to.
+     * Unused entries (and entry 0, which is never handed out) are chained
+     * from freeHandle through nextFree. handleLock is taken before any
+     * other lock, and is held across compaction so that the table always
+     * matches the blocks. */
+    struct handleEntry *handles;
+    int numHandles;
+    int freeHandle;
+    int liveHandles;
+    pthread_mutex_t handleLock;
+
+    /* The background compactor, if started. compactorLock guards the
+     * fields after it; the thread waits on compactorWake between looks at
+     * the arena. It holds pinLock for writing while it moves blocks, so a
+     * thread holding it for reading (kallocator_pin) sees nothing move. */
+    pthread_t compactor;
+    int compactorRunning;
+    pthread_mutex_t compactorLock;
+    pthread_cond_t compactorWake;
+    int compactorStop;
+    double compactorThreshold;
+    void (*compactorCallback)(void*, void*, void*);
+    void *compactorArg;
+    long long compactorPasses;
+    pthread_rwlock_t pinLock;
+
+    /* The allocation trace being recorded, if any. traceLock guards the
+     * fields after it, and is taken after any region's lock. Blocks carry
+     * their trace ids in their nodes, set under their region's lock, so
+     * the ids follow them wherever compaction puts them. */
+    int tracing;
+    pthread_mutex_t traceLock;
+    FILE *trace;
+    unsigned int traceNextId;
+    double traceLast;
+};
+
+/* Totals gathered from one or more regions for the statistics functions */
+struct regionStats {
+    int allocated_size;
+    int allocated_chunks;
+    int free_size;
+    int free_chunks;
+    int smallest_free_chunk_size;
+    int largest_free_chunk_size;
+    long metadata_bytes;
+    long metadata_nodes;
+    long metadata_mallocs;
+    long long free_calls;
+    long buddy_block_bytes;
+    long padding_bytes;
+    long usable_size;
+    long long searches;
+    long long search_steps;
+    long long merges;
+    long long merge_steps;
+    long long reallocs_in_place;
+    long long reallocs_moved;
+    long long compact_moves;
+    long long compact_bytes;
+    long long pages_released;
+    long long cache_hits;
+    long long cache_misses;
+    int cached_blocks;
+    long cached_bytes;
+};
+
+/* The allocator behind initialize_allocator, kalloc, kfree and the rest
+ * of the original single-arena API. */
+static struct KAllocator kallocator;
+
+static int kallocator_init(struct KAllocator *ka, int _size, int _maxSize, enum allocation_algorithm _aalgorithm, int _flags, int _fd);
+static int kallocator_init_file(struct KAllocator *ka, const char *_path, int _size, enum allocation_algorithm _aalgorithm, int _flags);
+static void kallocator_release(struct KAllocator *ka);
+static int home_region(struct KAllocator *ka);
+static struct KRegion* region_of(struct KAllocator *ka, void *_ptr);
+static void lock_all_regions(struct KAllocator *ka);
+static void unlock_all_regions(struct KAllocator *ka);
+static struct threadCache* thread_cache(struct KAllocator *ka);
+static void cache_thread_exit(void *_cache);
+static int cache_bin_of(void *_ptr);
+static void cache_refill(struct KAllocator *ka, struct threadCache *tc, int _bin);
+static void cache_flush(struct KAllocator *ka, struct threadCache *tc, int _bin, int _count);
+static void cache_drain(struct KAllocator *ka, struct threadCache *tc);
+static void lock_all_caches(struct KAllocator *ka);
+static void unlock_all_caches(struct KAllocator *ka);
+static void region_init(struct KRegion *r, struct KAllocator *owner, void *_memory, int _size);
+static void region_release(struct KRegion *r);
+static int grow_and_alloc(struct KAllocator *ka, int _size, int _alignment, int _count, void **_ptrs);
+static long grow_shortfall(struct KRegion *r, int _size, int _alignment, int _count);
+static int region_grow(struct KRegion *r, long _bytes);
+static void* region_alloc(struct KRegion *r, int _size, int _alignment);
+static int region_alloc_run(struct KRegion *r, int _size, int _alignment, int _count, void **_ptrs);
+static void region_free(struct KRegion *r, void *_ptr);
+static void region_free_run(struct KRegion *r, void **_ptrs, int _count);
+static int compare_ptrs(const void *a, const void *b);
+static int region_resize(struct KRegion *r, void *_ptr, int _size, int *_capacity, int *_alignment);
+static int list_resize(struct KRegion *r, struct nodeStruct *node, int _size);
+static int tagged_resize(struct KRegion *r, struct nodeStruct *node, int _size);
+static int buddy_resize(struct KRegion *r, struct nodeStruct *node, int _size);
+static int region_compact(struct KRegion *r, void **_before, void **_after, int *_sizes);
+static int region_compact_step(struct KRegion *r, int _maxBytes, int *_moved, void **_before, void **_after, int *_done);
+static void compact_restart(struct KRegion *r, void *_start);
+static void handle_moved(struct KAllocator *ka, struct nodeStruct *node);
+static void* arena_alloc(struct KAllocator *ka, int _size, int _alignment);
+static void arena_free(struct KAllocator *ka, void *_ptr);
+static void trace_write(struct KAllocator *ka, int _op, int _size, unsigned int _id, int _alignment);
+static void trace_alloc(struct KAllocator *ka, void **_ptrs, int _count, int _size, int _alignment, int _batch);
+static void trace_free(struct KAllocator *ka, void **_ptrs, int _count, int _batch);
+static void trace_realloc(struct KAllocator *ka, void *_before, void *_after, int _size);
+static void trace_compact(struct KAllocator *ka, int _op, int _maxBytes);
+static int grow_handles(struct KAllocator *ka);
+static void* compactor_main(void *_ka);
+static int compactor_stopping(struct KAllocator *ka);
+static long long compactor_activity(struct KAllocator *ka);
+static double fragmentation(struct KAllocator *ka);
+static long resident_bytes(struct KAllocator *ka, long _committed);
+static void region_add_stats(struct KRegion *r, struct regionStats *stats);
+static void region_debug_print(struct KRegion *r, int selector);
+static int size_class(int _size);
+static void class_insert(struct KRegion *r, struct nodeStruct *node);
+static void class_remove(struct KRegion *r, struct nodeStruct *node);
+static void class_reset(struct KRegion *r);
+static void find_free_extremes(struct KRegion *r);
+static void count_allocated(struct KRegion *r, struct nodeStruct *node, int _sign);
+static int next_nonempty_class(struct KRegion *r, int _class);
+static int is_tlsf(struct KRegion *r);
+static int size_range(int _size, int _class);
+static struct nodeStruct* lowest_range_head(struct KRegion *r, int _size);
+static struct nodeStruct* tlsf_find(struct KRegion *r, int _size);
+static struct nodeStruct* find_free_block(struct KRegion *r, int _size);
+static struct nodeStruct* next_fit_find(struct KRegion *r, int _size);
+static void free_list_delete(struct KRegion *r, struct nodeStruct *node, struct nodeStruct *_successor);
+static void release_block(struct KRegion *r, void *_ptr, int _size);
+static void release_tagged_block(struct KRegion *r, void *_start, int _size);
+static void release_pages(struct KRegion *r, void *_block, int _blockSize, void *_from, void *_to);
+static void* map_arena(struct KAllocator *ka, int _hugePages);
+static int huge_pages_available(void);
+static void* map_file(struct KAllocator *ka, int _fd);
+static void unmap_arena(struct KAllocator *ka);
+static unsigned int persist_checksum(struct persistHeader *header);
+static int persist_blank(struct persistHeader *header);
+static int persist_header_valid(struct persistHeader *header, long _fileSize);
+static void persist_format(struct KAllocator *ka);
+static int persist_attach(struct KAllocator *ka);
+static void persist_detach(struct KAllocator *ka);
+static int region_check_tags(struct KRegion *r);
+static void region_rebuild(struct KRegion *r);
+static void reset_free_blocks(struct KRegion *r, void *_start, int _size);
+static struct nodeStruct* add_free_block(struct KRegion *r, struct nodeStruct *_previous, void *_start, int _size);
+static struct nodeStruct* split_free_block(struct KRegion *r, struct nodeStruct *node, int _front);
+static int block_extent(struct KRegion *r, int _size);
+static int alignment_pad(struct KRegion *r, void *_start, int _alignment);
+static int is_buddy(struct KRegion *r);
+static int buddy_order(int _size);
+static int buddy_fits(struct KRegion *r, int _offset, int _order);
+static struct nodeStruct* buddy_insert_free(struct KRegion *r, int _offset, int _order);
+static struct nodeStruct* buddy_merge(struct KRegion *r, int _offset, int _order);
+static void buddy_release_range(struct KRegion *r, int _start, int _end);
+static void* buddy_alloc(struct KRegion *r, int _size, int _alignment);
+static void buddy_free(struct KRegion *r, void *_ptr, int _order);
+static int has_tags(struct KRegion *r);
+static void write_tags(void *_start, int _size, int _free);
+static unsigned int read_tag(void *_at);
+static int tag_size(unsigned int _tag);
+static int tag_is_free(unsigned int _tag);
+static double now_ns(void);
+
+struct KAllocator* kallocator_create(int _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    struct KAllocator *ka = malloc(sizeof(struct KAllocator));
+
+    if (ka != NULL && !kallocator_init(ka, _size, _size, _aalgorithm, _flags, -1)){
+        free(ka);
+        ka = NULL;
+    }
+    return ka;
+}
+
+struct KAllocator* kallocator_create_growable(int _size, int _maxSize, enum allocation_algorithm _aalgorithm, int _flags) {
+    struct KAllocator *ka = malloc(sizeof(struct KAllocator));
+
+    if (ka != NULL && !kallocator_init(ka, _size, _maxSize, _aalgorithm, _flags, -1)){
+        free(ka);
+        ka = NULL;
+    }
+    return ka;
+}
+
+struct KAllocator* kallocator_open(const char *_path, int _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    struct KAllocator *ka = malloc(sizeof(struct KAllocator));
+
+    if (ka != NULL && !kallocator_init_file(ka, _path, _size, _aalgorithm, _flags)){
+        free(ka);
+        ka = NULL;
+    }
+    return ka;
+}
+
+void kallocator_destroy(struct KAllocator *ka) {
+    kallocator_release(ka);
+    free(ka);
+}
+
+/* Sets up ka with an arena of _size bytes, which may grow to _maxSize.
+ * With an _fd, the arena is kept in that file instead (see
+ * kallocator_init_file), and if the file already holds a heap, ka takes
+ * it over. Returns 0 if the arena could not be allocated or the heap in
+ * the file does not check out. */
+static int kallocator_init(struct KAllocator *ka, int _size, int _maxSize, enum allocation_algorithm _aalgorithm, int _flags, int _fd) {
+    int numRegions = KALLOC_REGIONS_OF(_flags);
+
+    assert(_size > 0);
+    assert(numRegions <= _size);
+    if (_aalgorithm == BUDDY){
+        _flags &= ~(KALLOC_BOUNDARY_TAGS | KALLOC_THREAD_CACHE);
+    }
+    if ((_flags & KALLOC_THREAD_CACHE) || _aalgorithm == TLSF){
+        _flags |= KALLOC_BOUNDARY_TAGS;
+    }
+    ka->aalgorithm = _aalgorithm;
+    ka->flags = _flags;
+    ka->size = (_maxSize > _size) ? _maxSize : _size;
+    ka->growable = (ka->size > _size);
+    ka->alignment = KALLOC_ALIGN_OF(_flags);
+    if ((_flags & KALLOC_BOUNDARY_TAGS) && ka->alignment < MIN_TAGGED_BLOCK){
+        ka->alignment = MIN_TAGGED_BLOCK;
+    }
+
+    /* The whole arena is reserved as address space up front, so it can
+     * grow in place, but only the first _size bytes are committed */
+    ka->pageSize = sysconf(_SC_PAGESIZE);
+    ka->reserved = ((size_t)ka->size + (size_t)ka->pageSize - 1) & ~((size_t)ka->pageSize - 1);
+    ka->persist = NULL;
+    ka->memory = (_fd >= 0) ? map_file(ka, _fd) : map_arena(ka, (_flags & KALLOC_HUGE_PAGES) != 0);
+    ka->pageUnit = ka->hugePages ? HUGE_PAGE_SIZE : ka->pageSize;
+    ka->committed = ((long)_size + ka->pageUnit - 1) & ~(ka->pageUnit - 1);
+    if (ka->committed > (long)ka->reserved){
+        ka->committed = (long)ka->reserved;
+    }
+    if (ka->memory != NULL && ka->persist == NULL && mprotect(ka->memory, (size_t)ka->committed, PROT_READ | PROT_WRITE) != 0){
+        unmap_arena(ka);
+        ka->memory = NULL;
+    }
+    ka->numRegions = numRegions;
+    ka->regionSize = _size / numRegions;
+    if (numRegions > 1){
+        int granule = (ka->regionSize >= ARENA_ALIGN) ? ARENA_ALIGN : REGION_ALIGN_SMALL;
+        if (ka->hugePages && ka->regionSize >= HUGE_PAGE_SIZE){
+            granule = HUGE_PAGE_SIZE;
+        }
+        if (ka->regionSize >= granule){
+            ka->regionSize &= ~(granule - 1);
+        }
+    }
+    ka->regions = malloc(sizeof(struct KRegion) * (size_t)numRegions);
+    if (ka->memory == NULL || ka->regions == NULL){
+        if (ka->memory != NULL){
+            unmap_arena(ka);
+        }
+        free(ka->regions);
+        return 0;
+    }
+
+    /* A reattached heap is rebuilt from its tags once ka is set up */
+    ka->reattached = (ka->persist != NULL && !persist_blank(ka->persist));
+    for (int i = 0; i < numRegions; ++i){
+        int regionSize = (i == numRegions - 1) ? _size - ka->regionSize * i : ka->regionSize;
+        struct KRegion *r = &ka->regions[i];
+
+        region_init(r, ka, (char*)ka->memory + (size_t)ka->regionSize * (size_t)i, regionSize);
+        reset_free_blocks(r, r->memory, ka->reattached ? 0 : r->size);
+    }
+
+    ka->caches = NULL;
+    ka->retiredHits = 0;
+    ka->retiredMisses = 0;
+    ka->compactRegion = 0;
+    ka->handles = NULL;
+    ka->numHandles = 0;
+    ka->freeHandle = 0;
+    ka->liveHandles = 0;
+    pthread_mutex_init(&ka->handleLock, NULL);
+    ka->compactorRunning = 0;
+    ka->compactorPasses = 0;
+    pthread_mutex_init(&ka->compactorLock, NULL);
+    pthread_cond_init(&ka->compactorWake, NULL);
+    pthread_rwlock_init(&ka->pinLock, NULL);
+    pthread_mutex_init(&ka->cacheListLock, NULL);
+    ka->tracing = 0;
+    ka->trace = NULL;
+    pthread_mutex_init(&ka->traceLock, NULL);
+    if (_flags & KALLOC_THREAD_CACHE){
+        pthread_key_create(&ka->cacheKey, cache_thread_exit);
+    }
+
+    if (ka->reattached && !persist_attach(ka)){
+        kallocator_release(ka);
+        return 0;
+    }
+    if (ka->persist != NULL && !ka->reattached){
+        persist_format(ka);
+    }
+    return 1;
+}
+
+/* Opens (creating it if need be) the file at _path and sets ka up on it.
+ * A file that is empty, or was never finished being set up, gets a new
+ * arena of _size bytes; otherwise its header says how the arena it holds
+ * was made, and _size, _aalgorithm and _flags are ignored. Returns 0 if
+ * the file cannot be used. */
+static int kallocator_init_file(struct KAllocator *ka, const char *_path, int _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    struct persistHeader header;
+    struct stat st;
+    int initialized = 0;
+    int fd = open(_path, O_RDWR | O_CREAT, 0600);
+
+    if (fd < 0){
+        return 0;
+    }
+    /* The heap is rebuilt from its boundary tags, which BUDDY does not
+     * have; the caches and huge pages do not fit a shared file mapping */
+    _flags = (_flags | KALLOC_BOUNDARY_TAGS) & ~(KALLOC_THREAD_CACHE | KALLOC_HUGE_PAGES);
+    if (fstat(fd, &st) == 0){
+        if (st.st_size >= (off_t)sizeof(header) && pread(fd, &header, sizeof(header), 0) == (ssize_t)sizeof(header)
+                && !persist_blank(&header)){
+            if (persist_header_valid(&header, (long)st.st_size)){
+                initialized = kallocator_init(ka, header.size, header.size, (enum allocation_algorithm)header.aalgorithm, header.flags, fd);
+            }
+        } else if (_aalgorithm != BUDDY && _size > 0 && _size <= INT_MAX - ARENA_ALIGN
+                && ftruncate(fd, (off_t)ARENA_ALIGN + _size) == 0){
+            initialized = kallocator_init(ka, _size, _size, _aalgorithm, _flags, fd);
+        }
+    }
+    /* The mapping keeps the file open */
+    close(fd);
+    return initialized;
+}
+
+static void kallocator_release(struct KAllocator *ka) {
+    kallocator_stop_compactor(ka);
+    kallocator_trace_stop(ka);
+    pthread_mutex_destroy(&ka->traceLock);
+    if (ka->persist != NULL){
+        persist_detach(ka);
+    }
+    pthread_mutex_destroy(&ka->compactorLock);
+    pthread_cond_destroy(&ka->compactorWake);
+    pthread_rwlock_destroy(&ka->pinLock);
+
+    /* The arena is about to go, so the cached blocks need not be freed */
+    if (ka->flags & KALLOC_THREAD_CACHE){
+        pthread_key_delete(ka->cacheKey);
+        while (ka->caches != NULL){
+            struct threadCache *tc = ka->caches;
+            ka->caches = tc->next;
+            pthread_mutex_destroy(&tc->lock);
+            free(tc);
+        }
+    }
+    pthread_mutex_destroy(&ka->cacheListLock);
+    pthread_mutex_destroy(&ka->handleLock);
+    free(ka->handles);
+    ka->handles = NULL;
+
+    for (int i = 0; i < ka->numRegions; ++i){
+        region_release(&ka->regions[i]);
+    }
+    free(ka->regions);
+    unmap_arena(ka);
+
+    /* Leave an empty allocator behind, so a stray debug_print is harmless */
+    ka->regions = NULL;
+    ka->numRegions = 0;
+    ka->memory = NULL;
+    ka->growable = 0;
+}
+
+void* kalloc_from(struct KAllocator *ka, int _size) {
+    return kalloc_aligned_from(ka, _size, ka->alignment);
+}
+
+void* kalloc_aligned_from(struct KAllocator *ka, int _size, int _alignment) {
+    if (_alignment <= 0 || (_alignment & (_alignment - 1)) != 0){
+        return NULL;
+    }
+    if (_alignment < ka->alignment){
+        _alignment = ka->alignment;
+    }
+
+    void *ptr = arena_alloc(ka, _size, _alignment);
+    if (TRACING(ka)){
+        trace_alloc(ka, (ptr != NULL) ? &ptr : NULL, 1, _size, _alignment, 0);
+    }
+    return ptr;
+}
+
+/* kalloc_aligned_from, for an _alignment that has been checked and is at
+ * least ka->alignment, without recording a trace */
+static void* arena_alloc(struct KAllocator *ka, int _size, int _alignment) {
+    void* ptr = NULL;
+    int home = home_region(ka);
+
+    if ((ka->flags & KALLOC_THREAD_CACHE) && _alignment == ka->alignment && _size > 0 && _size <= CACHE_MAX_SIZE){
+        struct threadCache *tc = thread_cache(ka);
+        if (tc != NULL){
+            int bin = (_size - 1) / CACHE_BIN_SIZE;
+
+            pthread_mutex_lock(&tc->lock);
+            if (tc->counts[bin] > 0){
+                ++tc->hits;
+            } else {
+                ++tc->misses;
+                cache_refill(ka, tc, bin);
+            }
+            if (tc->counts[bin] > 0){
+                ptr = tc->bins[bin][--tc->counts[bin]];
+                tc->bytes -= (bin + 1) * CACHE_BIN_SIZE;
+            }
+            pthread_mutex_unlock(&tc->lock);
+
+            if (ptr != NULL){
+                return ptr;
+            }
+        }
+    }
+
+    /* First try every region that is not busy, starting at this thread's
+     * home region, and only then wait for the busy ones. */
+    for (int i = 0; i < ka->numRegions && ptr == NULL; ++i){
+        struct KRegion *r = &ka->regions[(home + i) % ka->numRegions];
+        if (pthread_mutex_trylock(&r->lock) == 0){
+            ptr = region_alloc(r, _size, _alignment);
+            pthread_mutex_unlock(&r->lock);
+        }
+    }
+    for (int i = 0; i < ka->numRegions && ptr == NULL; ++i){
+        struct KRegion *r = &ka->regions[(home + i) % ka->numRegions];
+        pthread_mutex_lock(&r->lock);
+        ptr = region_alloc(r, _size, _alignment);
+        pthread_mutex_unlock(&r->lock);
+    }
+    if (ptr == NULL){
+        grow_and_alloc(ka, _size, _alignment, 1, &ptr);
+    }
+    return ptr;
+}
+
+void kfree_to(struct KAllocator *ka, void* _ptr) {
+    assert(_ptr != NULL);
+
+    if (TRACING(ka)){
+        trace_free(ka, &_ptr, 1, 0);
+    }
+    arena_free(ka, _ptr);
+}
+
+/* kfree_to without recording a trace */
+static void arena_free(struct KAllocator *ka, void *_ptr) {
+    if (ka->flags & KALLOC_THREAD_CACHE){
+        int bin = cache_bin_of(_ptr);
+        struct threadCache *tc = (bin >= 0) ? thread_cache(ka) : NULL;
+        if (tc != NULL){
+            pthread_mutex_lock(&tc->lock);
+            if (tc->counts[bin] == CACHE_BIN_LIMIT){
+                cache_flush(ka, tc, bin, CACHE_BATCH);
+            }
+            tc->bins[bin][tc->counts[bin]++] = _ptr;
+            tc->bytes += (bin + 1) * CACHE_BIN_SIZE;
+            if (tc->bytes > CACHE_BYTE_LIMIT){
+                cache_flush(ka, tc, bin, (tc->counts[bin] < CACHE_BATCH) ? tc->counts[bin] : CACHE_BATCH);
+            }
+            pthread_mutex_unlock(&tc->lock);
+            return;
+        }
+    }
+
+    struct KRegion *r = region_of(ka, _ptr);
+
+    pthread_mutex_lock(&r->lock);
+    region_free(r, _ptr);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void* krealloc_from(struct KAllocator *ka, void* _ptr, int _size) {
+    if (_ptr == NULL){
+        return kalloc_from(ka, _size);
+    }
+    if (_size <= 0){
+        kfree_to(ka, _ptr);
+        return NULL;
+    }
+
+    struct KRegion *r = region_of(ka, _ptr);
+    int capacity = 0;
+    int alignment = 0;
+
+    pthread_mutex_lock(&r->lock);
+    int resized = region_resize(r, _ptr, _size, &capacity, &alignment);
+    pthread_mutex_unlock(&r->lock);
+    if (resized){
+        if (TRACING(ka)){
+            trace_realloc(ka, _ptr, _ptr, _size);
+        }
+        return _ptr;
+    }
+
+    void *ptr = arena_alloc(ka, _size, alignment);
+    if (ptr != NULL){
+        memcpy(ptr, _ptr, (size_t)((capacity < _size) ? capacity : _size));
+        if (TRACING(ka)){
+            trace_realloc(ka, _ptr, ptr, _size);
+        }
+        arena_free(ka, _ptr);
+    }
+    return ptr;
+}
+
+int kalloc_batch_from(struct KAllocator *ka, int _size, int _count, void** _ptrs) {
+    int home = home_region(ka);
+    int allocated = 0;
+
+    if (_count <= 0){
+        return 0;
+    }
+
+    /* The same region order as kalloc_from, looking for room for the
+     * whole batch in one piece */
+    for (int i = 0; i < ka->numRegions && allocated == 0; ++i){
+        struct KRegion *r = &ka->regions[(home + i) % ka->numRegions];
+        if (pthread_mutex_trylock(&r->lock) == 0){
+            allocated = region_alloc_run(r, _size, ka->alignment, _count, _ptrs);
+            pthread_mutex_unlock(&r->lock);
+        }
+    }
+    for (int i = 0; i < ka->numRegions && allocated == 0; ++i){
+        struct KRegion *r = &ka->regions[(home + i) % ka->numRegions];
+        pthread_mutex_lock(&r->lock);
+        allocated = region_alloc_run(r, _size, ka->alignment, _count, _ptrs);
+        pthread_mutex_unlock(&r->lock);
+    }
+    if (allocated == 0){
+        allocated = grow_and_alloc(ka, _size, ka->alignment, _count, _ptrs);
+    }
+    if (allocated == 0){
+        /* No free block is large enough for all of them: one at a time */
+        while (allocated < _count && (_ptrs[allocated] = arena_alloc(ka, _size, ka->alignment)) != NULL){
+            ++allocated;
+        }
+        if (allocated < _count){
+            while (allocated > 0){
+                arena_free(ka, _ptrs[--allocated]);
+            }
+        }
+    }
+
+    if (TRACING(ka)){
+        trace_alloc(ka, (allocated > 0) ? _ptrs : NULL, _count, _size, ka->alignment, 1);
+    }
+    return allocated;
+}
+
+void kfree_batch_to(struct KAllocator *ka, void** _ptrs, int _count) {
+    int i = 0;
+
+    if (TRACING(ka)){
+        trace_free(ka, _ptrs, _count, 1);
+    }
+    qsort(_ptrs, (size_t)(_count > 0 ? _count : 0), sizeof(void*), compare_ptrs);
+    while (i < _count){
+        struct KRegion *r = region_of(ka, _ptrs[i]);
+        int n = 1;
+
+        assert(_ptrs[i] != NULL);
+        while (i + n < _count && region_of(ka, _ptrs[i + n]) == r){
+            ++n;
+        }
+        pthread_mutex_lock(&r->lock);
+        region_free_run(r, _ptrs + i, n);
+        pthread_mutex_unlock(&r->lock);
+        i += n;
+    }
+}
+
+int khandle_alloc_from(struct KAllocator *ka, int _size) {
+    int handle = 0;
+
+    pthread_mutex_lock(&ka->handleLock);
+    if (ka->freeHandle != 0 || grow_handles(ka)){
+        void *ptr = kalloc_from(ka, _size);
+        if (ptr != NULL){
+            struct KRegion *r = region_of(ka, ptr);
+
+            handle = ka->freeHandle;
+            ka->freeHandle = ka->handles[handle].nextFree;
+            ka->handles[handle].ptr = ptr;
+            ++ka->liveHandles;
+
+            /* The node carries its handle, so compaction can find the
+             * entry to update when it moves the block */
+            pthread_mutex_lock(&r->lock);
+            Index_find(&r->allocatedIndex, ptr)->handle = handle;
+            pthread_mutex_unlock(&r->lock);
+        }
+    }
+    pthread_mutex_unlock(&ka->handleLock);
+
+    return handle;
+}
+
+void* khandle_deref_from(struct KAllocator *ka, int _handle) {
+    void *ptr = NULL;
+
+    pthread_mutex_lock(&ka->handleLock);
+    assert(_handle > 0 && _handle < ka->numHandles);
+    ptr = ka->handles[_handle].ptr;
+    pthread_mutex_unlock(&ka->handleLock);
+
+    return ptr;
+}
+
+void khandle_free_from(struct KAllocator *ka, int _handle) {
+    pthread_mutex_lock(&ka->handleLock);
+    assert(_handle > 0 && _handle < ka->numHandles && ka->handles[_handle].ptr != NULL);
+
+    void *ptr = ka->handles[_handle].ptr;
+    struct KRegion *r = region_of(ka, ptr);
+    pthread_mutex_lock(&r->lock);
+    Index_find(&r->allocatedIndex, ptr)->handle = 0;
+    pthread_mutex_unlock(&r->lock);
+    kfree_to(ka, ptr);
+
+    ka->handles[_handle].ptr = NULL;
+    ka->handles[_handle].nextFree = ka->freeHandle;
+    ka->freeHandle = _handle;
+    --ka->liveHandles;
+    pthread_mutex_unlock(&ka->handleLock);
+}
+
+/* The root's node is marked with ROOT_HANDLE, so that compaction keeps
+ * the header's root up to date and kfree clears it. Every region is
+ * locked, as the root is only ever changed under its block's region lock
+ * and may be in any of them. */
+void kallocator_set_root(struct KAllocator *ka, void* _ptr) {
+    assert(ka->persist != NULL);
+
+    lock_all_regions(ka);
+    if (ka->persist->root >= 0){
+        void *root = (char*)ka->memory + ka->persist->root;
+        Index_find(&region_of(ka, root)->allocatedIndex, root)->handle = 0;
+        ka->persist->root = -1;
+    }
+    if (_ptr != NULL){
+        struct nodeStruct *node = Index_find(&region_of(ka, _ptr)->allocatedIndex, _ptr);
+        assert(node != NULL && node->handle == 0);
+        node->handle = ROOT_HANDLE;
+        ka->persist->root = (char*)_ptr - (char*)ka->memory;
+    }
+    unlock_all_regions(ka);
+}
+
+void* kallocator_root(struct KAllocator *ka) {
+    void *root = NULL;
+
+    lock_all_regions(ka);
+    if (ka->persist != NULL && ka->persist->root >= 0){
+        root = (char*)ka->memory + ka->persist->root;
+    }
+    unlock_all_regions(ka);
+    return root;
+}
+
+/* The header goes out first, so that a trace is readable as soon as it is
+ * started. Ids left in the nodes by an earlier trace are cleared, with
+ * every region locked so that no block is being traced meanwhile. */
+int kallocator_trace_start(struct KAllocator *ka, const char* _path) {
+    struct ktraceHeader header;
+    FILE *trace = NULL;
+
+    pthread_mutex_lock(&ka->traceLock);
+    if (ka->trace == NULL){
+        trace = fopen(_path, "wb");
+    }
+    pthread_mutex_unlock(&ka->traceLock);
+    if (trace == NULL){
+        return 0;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KTRACE_MAGIC, sizeof(header.magic));
+    header.size = ka->size;
+    header.aalgorithm = ka->aalgorithm;
+    header.flags = ka->flags;
+    if (fwrite(&header, sizeof(header), 1, trace) != 1){
+        fclose(trace);
+        return 0;
+    }
+
+    lock_all_regions(ka);
+    for (int i = 0; i < ka->numRegions; ++i){
+        for (struct nodeStruct *current = ka->regions[i].allocatedBlocks; current != NULL; current = current->next){
+            current->traceId = 0;
+        }
+    }
+    pthread_mutex_lock(&ka->traceLock);
+    int started = (ka->trace == NULL);
+    if (started){
+        ka->trace = trace;
+        ka->traceNextId = 0;
+        ka->traceLast = now_ns();
+        __atomic_store_n(&ka->tracing, 1, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&ka->traceLock);
+    unlock_all_regions(ka);
+
+    if (!started){
+        fclose(trace);
+    }
+    return started;
+}
+
+void kallocator_trace_stop(struct KAllocator *ka) {
+    pthread_mutex_lock(&ka->traceLock);
+    FILE *trace = ka->trace;
+    ka->trace = NULL;
+    __atomic_store_n(&ka->tracing, 0, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&ka->traceLock);
+
+    if (trace != NULL){
+        fclose(trace);
+    }
+}
+
+/* Each region is compacted towards its own start; the relocations of all
+ * regions are reported together. */
+int kallocator_compact(struct KAllocator *ka, void** _before, void** _after) {
+    int compacted_size = 0;
+
+    /* Cached blocks go back to the regions first, and the caches stay
+     * locked so they cannot take new blocks until the moves are done. */
+    pthread_mutex_lock(&ka->handleLock);
+    lock_all_caches(ka);
+    lock_all_regions(ka);
+    for (int i = 0; i < ka->numRegions; ++i){
+        compacted_size += region_compact(&ka->regions[i], _before + compacted_size, _after + compacted_size, NULL);
+    }
+    if (TRACING(ka)){
+        trace_compact(ka, KTRACE_COMPACT, 0);
+    }
+    unlock_all_regions(ka);
+    unlock_all_caches(ka);
+    pthread_mutex_unlock(&ka->handleLock);
+
+    return compacted_size;
+}
+
+/* Compacts like kallocator_compact, with every cache and region locked,
+ * and gathers the moves of all regions into one map sorted by old
+ * address. */
+struct krelocMap* kallocator_compact_map(struct KAllocator *ka) {
+    struct krelocMap *map = malloc(sizeof(struct krelocMap));
+    int capacity = 0;
+
+    if (map == NULL){
+        return NULL;
+    }
+
+    pthread_mutex_lock(&ka->handleLock);
+    lock_all_caches(ka);
+    lock_all_regions(ka);
+    for (int i = 0; i < ka->numRegions; ++i){
+        capacity += ka->regions[i].allocatedIndex.count;
+    }
+    map->count = 0;
+    map->before = malloc(sizeof(void*) * (size_t)(capacity + 1));
+    map->after = malloc(sizeof(void*) * (size_t)(capacity + 1));
+    map->sizes = malloc(sizeof(int) * (size_t)(capacity + 1));
+    if (map->before != NULL && map->after != NULL && map->sizes != NULL){
+        /* Each region moves its blocks in address order, and the regions
+         * are in address order, so the map comes out sorted */
+        for (int i = 0; i < ka->numRegions; ++i){
+            map->count += region_compact(&ka->regions[i], map->before + map->count, map->after + map->count, map->sizes + map->count);
+        }
+        if (TRACING(ka)){
+            trace_compact(ka, KTRACE_COMPACT, 0);
+        }
+    } else {
+        kreloc_free(map);
+        map = NULL;
+    }
+    unlock_all_regions(ka);
+    unlock_all_caches(ka);
+    pthread_mutex_unlock(&ka->handleLock);
+
+    return map;
+}
+
+void* kreloc_lookup(struct krelocMap* map, void* _ptr) {
+    uintptr_t ptr = (uintptr_t)_ptr;
+    int low = 0;
+    int high = (map != NULL) ? map->count : 0;
+
+    /* Find the last block that starts at or below _ptr */
+    while (low < high){
+        int mid = low + (high - low) / 2;
+        if ((uintptr_t)map->before[mid] <= ptr){
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low > 0 && ptr - (uintptr_t)map->before[low - 1] < (uintptr_t)map->sizes[low - 1]){
+        return (char*)map->after[low - 1] + (ptr - (uintptr_t)map->before[low - 1]);
+    }
+    return _ptr;
+}
+
+int kreloc_count(struct krelocMap* map) {
+    return (map != NULL) ? map->count : 0;
+}
+
+void kreloc_free(struct krelocMap* map) {
+    if (map != NULL){
+        free(map->before);
+        free(map->after);
+        free(map->sizes);
+        free(map);
+    }
+}
+
+/* The regions are worked through in turn, each until it is done or the
+ * budget runs out, so one call may finish one region and start the next. */
+int kallocator_compact_step(struct KAllocator *ka, int _maxBytes, void** _before, void** _after, int* _done) {
+    int compacted_size = 0;
+    int moved = 0;
+    int regionDone = 0;
+
+    *_done = 0;
+    pthread_mutex_lock(&ka->handleLock);
+    lock_all_caches(ka);
+    while (!*_done && (compacted_size == 0 || moved < _maxBytes)){
+        struct KRegion *r = &ka->regions[ka->compactRegion];
+
+        pthread_mutex_lock(&r->lock);
+        compacted_size += region_compact_step(r, _maxBytes, &moved, _before + compacted_size, _after + compacted_size, &regionDone);
+        pthread_mutex_unlock(&r->lock);
+        if (!regionDone){
+            break;
+        }
+        ka->compactRegion = (ka->compactRegion + 1) % ka->numRegions;
+        *_done = (ka->compactRegion == 0);
+    }
+    if (TRACING(ka)){
+        trace_compact(ka, KTRACE_COMPACT_STEP, _maxBytes);
+    }
+    unlock_all_caches(ka);
+    pthread_mutex_unlock(&ka->handleLock);
+
+    return compacted_size;
+}
+
+int kallocator_start_compactor(struct KAllocator *ka, double _threshold, void (*_callback)(void*, void*, void*), void* _arg) {
+    int started = 0;
+
+    pthread_mutex_lock(&ka->compactorLock);
+    if (!ka->compactorRunning){
+        ka->compactorStop = 0;
+        ka->compactorThreshold = _threshold;
+        ka->compactorCallback = _callback;
+        ka->compactorArg = _arg;
+        ka->compactorRunning = (pthread_create(&ka->compactor, NULL, compactor_main, ka) == 0);
+        started = ka->compactorRunning;
+    }
+    pthread_mutex_unlock(&ka->compactorLock);
+
+    return started;
+}
+
+void kallocator_stop_compactor(struct KAllocator *ka) {
+    pthread_mutex_lock(&ka->compactorLock);
+    int running = ka->compactorRunning;
+    ka->compactorStop = 1;
+    pthread_cond_signal(&ka->compactorWake);
+    pthread_mutex_unlock(&ka->compactorLock);
+
+    if (running){
+        pthread_join(ka->compactor, NULL);
+        pthread_mutex_lock(&ka->compactorLock);
+        ka->compactorRunning = 0;
+        pthread_mutex_unlock(&ka->compactorLock);
+    }
+}
+
+void kallocator_pin(struct KAllocator *ka) {
+    pthread_rwlock_rdlock(&ka->pinLock);
+}
+
+void kallocator_unpin(struct KAllocator *ka) {
+    pthread_rwlock_unlock(&ka->pinLock);
+}
+
+/* Every COMPACTOR_INTERVAL_MS, the compactor makes a pass over the arena
+ * if anything has been allocated or freed since its last pass, and either
+ * nothing has since its last look (the allocator is idle) or the free
+ * memory is more fragmented than the threshold. A pass is made of
+ * compact_steps, with the locks let go in between so that kalloc and
+ * kfree are only ever held up for one step. */
+static void* compactor_main(void *_ka) {
+    struct KAllocator *ka = _ka;
+    /* A step moves at most one block per alignment unit of its budget,
+     * besides the one it always moves */
+    int capacity = COMPACTOR_STEP_BYTES / ka->alignment + 1;
+    void **before = malloc(sizeof(void*) * (size_t)capacity);
+    void **after = malloc(sizeof(void*) * (size_t)capacity);
+    long long lastLook = -1;
+    long long lastPass = compactor_activity(ka);
+
+    pthread_mutex_lock(&ka->compactorLock);
+    while (!ka->compactorStop && before != NULL && after != NULL){
+        struct timespec wake;
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_nsec += COMPACTOR_INTERVAL_MS * 1000000L;
+        wake.tv_sec += wake.tv_nsec / 1000000000L;
+        wake.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&ka->compactorWake, &ka->compactorLock, &wake);
+        if (ka->compactorStop){
+            break;
+        }
+        pthread_mutex_unlock(&ka->compactorLock);
+
+        long long activity = compactor_activity(ka);
+        int idle = (activity == lastLook);
+        lastLook = activity;
+        int passed = 0;
+        if (activity != lastPass && (idle || fragmentation(ka) > ka->compactorThreshold)){
+            int done = 0;
+            while (!done && !compactor_stopping(ka)){
+                pthread_rwlock_wrlock(&ka->pinLock);
+                if (ka->aalgorithm == BUDDY){
+                    /* BUDDY steps compact whole regions, which may hold
+                     * any number of blocks; the map is sized to fit */
+                    struct krelocMap *map = kallocator_compact_map(ka);
+                    for (int i = 0; i < kreloc_count(map) && ka->compactorCallback != NULL; ++i){
+                        ka->compactorCallback(map->before[i], map->after[i], ka->compactorArg);
+                    }
+                    kreloc_free(map);
+                    done = 1;
+                } else {
+                    int moves = kallocator_compact_step(ka, COMPACTOR_STEP_BYTES, before, after, &done);
+                    for (int i = 0; i < moves && ka->compactorCallback != NULL; ++i){
+                        ka->compactorCallback(before[i], after[i], ka->compactorArg);
+                    }
+                }
+                pthread_rwlock_unlock(&ka->pinLock);
+                sched_yield();
+            }
+            lastPass = compactor_activity(ka);
+            lastLook = lastPass;
+            passed = done;
+        }
+
+        pthread_mutex_lock(&ka->compactorLock);
+        ka->compactorPasses += passed;
+    }
+    pthread_mutex_unlock(&ka->compactorLock);
+
+    free(before);
+    free(after);
+    return NULL;
+}
+
+static int compactor_stopping(struct KAllocator *ka) {
+    pthread_mutex_lock(&ka->compactorLock);
+    int stop = ka->compactorStop;
+    pthread_mutex_unlock(&ka->compactorLock);
+
+    return stop;
+}
+
+/* Counts the calls that have reached the regions so far */
+static long long compactor_activity(struct KAllocator *ka) {
+    long long activity = 0;
+
+    for (int i = 0; i < ka->numRegions; ++i){
+        struct KRegion *r = &ka->regions[i];
+        pthread_mutex_lock(&r->lock);
+        activity += r->allocCalls + r->freeCalls + r->reallocsInPlace;
+        pthread_mutex_unlock(&r->lock);
+    }
+    return activity;
+}
+
+/* 0 when all the free memory is in one block, approaching 1 as it is
+ * split into smaller and smaller ones */
+static double fragmentation(struct KAllocator *ka) {
+    struct kallocStats stats = kallocator_get_stats(ka);
+
+    return (stats.free_size > 0) ? 1.0 - (double)stats.largest_free_chunk_size / (double)stats.free_size : 0.0;
+}
+
+struct kallocStats kallocator_get_stats(struct KAllocator *ka) {
+    struct kallocStats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    for (int i = 0; i < ka->numRegions; ++i){
+        struct KRegion *r = &ka->regions[i];
+        int largest = STAT_READ(r->largestFree);
+        int smallest = STAT_READ(r->smallestFree);
+
+        stats.allocated_size += STAT_READ(r->allocatedBytes);
+        stats.allocated_chunks += STAT_READ(r->allocatedChunks);
+        stats.free_size += STAT_READ(r->freeBytes);
+        stats.free_chunks += STAT_READ(r->freeChunks);
+        stats.largest_free_chunk_size = (largest > stats.largest_free_chunk_size) ? largest : stats.largest_free_chunk_size;
+        if (smallest > 0 && (stats.smallest_free_chunk_size == 0 || smallest < stats.smallest_free_chunk_size)){
+            stats.smallest_free_chunk_size = smallest;
+        }
+    }
+    return stats;
+}
+
+int kallocator_available_memory(struct KAllocator *ka) {
+    return kallocator_get_stats(ka).free_size;
+}
+
+void kallocator_print_statistics(struct KAllocator *ka) {
+    struct regionStats stats;
+
+    memset(&stats, 0, sizeof(stats));
+    stats.smallest_free_chunk_size = ka->size;
+
+    // Calculate the statistics
+    for (int i = 0; i < ka->numRegions; ++i){
+        pthread_mutex_lock(&ka->regions[i].lock);
+        region_add_stats(&ka->regions[i], &stats);
+        pthread_mutex_unlock(&ka->regions[i].lock);
+    }
+
+    pthread_mutex_lock(&ka->cacheListLock);
+    stats.cache_hits = ka->retiredHits;
+    stats.cache_misses = ka->retiredMisses;
+    for (struct threadCache *tc = ka->caches; tc != NULL; tc = tc->next){
+        pthread_mutex_lock(&tc->lock);
+        stats.cache_hits += tc->hits;
+        stats.cache_misses += tc->misses;
+        stats.cached_bytes += tc->bytes;
+        for (int bin = 0; bin < CACHE_BINS; ++bin){
+            stats.cached_blocks += tc->counts[bin];
+        }
+        pthread_mutex_unlock(&tc->lock);
+    }
+    pthread_mutex_unlock(&ka->cacheListLock);
+
+    pthread_mutex_lock(&ka->handleLock);
+    int liveHandles = ka->liveHandles;
+    pthread_mutex_unlock(&ka->handleLock);
+    pthread_mutex_lock(&ka->compactorLock);
+    long long compactorPasses = ka->compactorPasses;
+    pthread_mutex_unlock(&ka->compactorLock);
+
+    printf("Allocated size = %d\n", stats.allocated_size);
+    printf("Allocated chunks = %d\n", stats.allocated_chunks);
+    printf("Free size = %d\n", stats.free_size);
+    printf("Free chunks = %d\n", stats.free_chunks);
+    printf("Largest free chunk size = %d\n", stats.largest_free_chunk_size);
+    printf("Smallest free chunk size = %d\n", stats.smallest_free_chunk_size);
+    if (ka->numRegions > 1){
+        printf("Regions = %d\n", ka->numRegions);
+    }
+    if (ka->aalgorithm != BUDDY){
+        printf("Alignment padding = %ld (%d byte alignment)\n", stats.padding_bytes, ka->alignment);
+    }
+    if (ka->flags & KALLOC_BOUNDARY_TAGS){
+        /* Whatever is neither payload, padding nor free is tags */
+        long overhead = stats.usable_size - stats.allocated_size - stats.free_size - stats.padding_bytes;
+        printf("Boundary tag overhead = %ld (%.1f per allocated chunk)\n", overhead,
+                (stats.allocated_chunks > 0) ? (double)overhead / stats.allocated_chunks : 0.0);
+    }
+    if (ka->aalgorithm == BUDDY){
+        long waste = stats.buddy_block_bytes - stats.allocated_size;
+        printf("Buddy internal fragmentation = %ld (%.1f%% of allocated blocks)\n", waste,
+                (stats.buddy_block_bytes > 0) ? 100.0 * (double)waste / (double)stats.buddy_block_bytes : 0.0);
+    }
+    if (ka->flags & KALLOC_THREAD_CACHE){
+        printf("Thread cache hits = %lld, misses = %lld\n", stats.cache_hits, stats.cache_misses);
+        printf("Thread cached blocks = %d (%ld bytes, counted as allocated)\n", stats.cached_blocks, stats.cached_bytes);
+    }
+    printf("Metadata bytes = %ld (%ld nodes in use)\n", stats.metadata_bytes, stats.metadata_nodes);
+    printf("Metadata malloc calls = %ld\n", stats.metadata_mallocs);
+    printf("kfree calls = %lld\n", stats.free_calls);
+    if (stats.reallocs_in_place + stats.reallocs_moved > 0){
+        printf("krealloc calls = %lld (%lld in place)\n",
+                stats.reallocs_in_place + stats.reallocs_moved, stats.reallocs_in_place);
+    }
+    if (liveHandles > 0){
+        printf("Handles in use = %d\n", liveHandles);
+    }
+    if (ka->numRegions > 0){
+        pthread_mutex_lock(&ka->regions[ka->numRegions - 1].lock);
+        long committed = ka->committed;
+        pthread_mutex_unlock(&ka->regions[ka->numRegions - 1].lock);
+        printf("Arena resident = %ld, committed = %ld, reserved = %ld bytes\n",
+                resident_bytes(ka, committed), committed, (long)ka->reserved);
+    }
+    if (ka->persist != NULL){
+        printf("Arena file = %s\n", ka->reattached ? "reattached" : "new");
+    }
+    if (ka->flags & KALLOC_HUGE_PAGES){
+        printf("Transparent huge pages = %s\n", ka->hugePages ? "on" : "unavailable");
+    }
+    if (stats.pages_released > 0){
+        printf("Pages returned to the OS = %lld\n", stats.pages_released);
+    }
+    if (compactorPasses > 0){
+        printf("Background compaction passes = %lld\n", compactorPasses);
+    }
+    if (stats.compact_moves > 0){
+        printf("Compaction moves = %lld (%lld bytes copied)\n", stats.compact_moves, stats.compact_bytes);
+    }
+    if (ka->aalgorithm != BUDDY && ka->aalgorithm != TLSF){
+        printf("Average kalloc search length = %.1f blocks\n",
+                (stats.searches > 0) ? (double)stats.search_steps / (double)stats.searches : 0.0);
+    }
+    if (ka->aalgorithm != BUDDY){
+        printf("Average merge search length = %.1f blocks\n",
+                (stats.merges > 0) ? (double)stats.merge_steps / (double)stats.merges : 0.0);
+    }
+}
+
+int kallocator_get_free_size(struct KAllocator *ka){
+    return kallocator_get_stats(ka).free_size;
+}
+
+void kallocator_debug_print(struct KAllocator *ka, int selector){
+    for (int i = 0; i < ka->numRegions; ++i){
+        if (ka->numRegions > 1){
+            printf("\n\nDEBUG: debug_print | region %d\n", i);
+        }
+        pthread_mutex_lock(&ka->regions[i].lock);
+        region_debug_print(&ka->regions[i], selector);
+        pthread_mutex_unlock(&ka->regions[i].lock);
+    }
+}
+
+
+/* Threads are handed out home regions round-robin, the first time they
+ * allocate; threadSlot is shared by every allocator instance. */
+static __thread int threadSlot = -1;
+static int nextThreadSlot = 0;
+
+static int home_region(struct KAllocator *ka){
+    if (threadSlot < 0){
+        threadSlot = __sync_fetch_and_add(&nextThreadSlot, 1) & 0x7fffffff;
+    }
+    return threadSlot % ka->numRegions;
+}
+
+static struct KRegion* region_of(struct KAllocator *ka, void *_ptr){
+    long offset = (long)((char*)_ptr - (char*)ka->memory);
+    long i = offset / ka->regionSize;
+
+    assert(offset >= 0 && offset < ka->size);
+    return &ka->regions[(i < ka->numRegions) ? i : ka->numRegions - 1];
+}
+
+/* Regions are always locked in index order, so this cannot deadlock
+ * with another caller doing the same. */
+static void lock_all_regions(struct KAllocator *ka){
+    for (int i = 0; i < ka->numRegions; ++i){
+        pthread_mutex_lock(&ka->regions[i].lock);
+    }
+}
+
+static void unlock_all_regions(struct KAllocator *ka){
+    for (int i = ka->numRegions - 1; i >= 0; --i){
+        pthread_mutex_unlock(&ka->regions[i].lock);
+    }
+}
+
+
+/* Returns the calling thread's cache for ka, creating it on first use,
+ * or NULL if it could not be allocated. */
+static struct threadCache* thread_cache(struct KAllocator *ka){
+    struct threadCache *tc = pthread_getspecific(ka->cacheKey);
+
+    if (tc == NULL){
+        tc = calloc(1, sizeof(struct threadCache));
+        if (tc == NULL){
+            return NULL;
+        }
+        tc->owner = ka;
+        pthread_mutex_init(&tc->lock, NULL);
+
+        pthread_mutex_lock(&ka->cacheListLock);
+        tc->next = ka->caches;
+        ka->caches = tc;
+        pthread_mutex_unlock(&ka->cacheListLock);
+
+        pthread_setspecific(ka->cacheKey, tc);
+    }
+    return tc;
+}
+
+/* Runs when a thread with a cache exits: hands its blocks back and
+ * unregisters it. */
+static void cache_thread_exit(void *_cache){
+    struct threadCache *tc = _cache;
+    struct KAllocator *ka = tc->owner;
+
+    pthread_mutex_lock(&ka->cacheListLock);
+    pthread_mutex_lock(&tc->lock);
+    cache_drain(ka, tc);
+    ka->retiredHits += tc->hits;
+    ka->retiredMisses += tc->misses;
+    pthread_mutex_unlock(&tc->lock);
+
+    struct threadCache **link = &ka->caches;
+    while (*link != tc){
+        link = &(*link)->next;
+    }
+    *link = tc->next;
+    pthread_mutex_unlock(&ka->cacheListLock);
+
+    pthread_mutex_destroy(&tc->lock);
+    free(tc);
+}
+
+/* The cache bin an allocated block fits in, from the extent in its header
+ * tag, or -1 if it is too small or too large to be cached. The header of an
+ * allocated block only changes while it is being compacted, so it can be
+ * read without a lock. */
+static int cache_bin_of(void *_ptr){
+    int capacity = tag_size(read_tag((char*)_ptr - TAG_SIZE)) - MIN_TAGGED_BLOCK;
+
+    if (capacity < CACHE_BIN_SIZE || capacity >= CACHE_MAX_SIZE + CACHE_BIN_SIZE){
+        return -1;
+    }
+    return capacity / CACHE_BIN_SIZE - 1;
+}
+
+/* Allocates up to CACHE_BATCH blocks for _bin under a single region lock,
+ * trying the thread's home region first. tc must be locked. */
+static void cache_refill(struct KAllocator *ka, struct threadCache *tc, int _bin){
+    int size = (_bin + 1) * CACHE_BIN_SIZE;
+    int home = home_region(ka);
+
+    for (int i = 0; i < ka->numRegions && tc->counts[_bin] == 0; ++i){
+        struct KRegion *r = &ka->regions[(home + i) % ka->numRegions];
+
+        pthread_mutex_lock(&r->lock);
+        while (tc->counts[_bin] < CACHE_BATCH && tc->bytes + size <= CACHE_BYTE_LIMIT){
+            void *ptr = region_alloc(r, size, ka->alignment);
+            if (ptr == NULL){
+                break;
+            }
+            tc->bins[_bin][tc->counts[_bin]++] = ptr;
+            tc->bytes += size;
+        }
+        pthread_mutex_unlock(&r->lock);
+    }
+}
+
+/* Frees the _count oldest blocks of _bin, locking each region once per run
+ * of blocks that belong to it. tc must be locked. */
+static void cache_flush(struct KAllocator *ka, struct threadCache *tc, int _bin, int _count){
+    struct KRegion *locked = NULL;
+
+    for (int i = 0; i < _count; ++i){
+        void *ptr = tc->bins[_bin][i];
+        struct KRegion *r = region_of(ka, ptr);
+
+        if (r != locked){
+            if (locked != NULL){
+                pthread_mutex_unlock(&locked->lock);
+            }
+            pthread_mutex_lock(&r->lock);
+            locked = r;
+        }
+        region_free(r, ptr);
+    }
+    if (locked != NULL){
+        pthread_mutex_unlock(&locked->lock);
+    }
+
+    tc->counts[_bin] -= _count;
+    memmove(&tc->bins[_bin][0], &tc->bins[_bin][_count], sizeof(void*) * (size_t)tc->counts[_bin]);
+    tc->bytes -= (long)_count * (_bin + 1) * CACHE_BIN_SIZE;
+}
+
+/* Frees every block in tc. tc must be locked. */
+static void cache_drain(struct KAllocator *ka, struct threadCache *tc){
+    for (int bin = 0; bin < CACHE_BINS; ++bin){
+        cache_flush(ka, tc, bin, tc->counts[bin]);
+    }
+}
+
+/* Locks every cache, emptying each one. Caches are left locked, so
+ * cacheListLock is held until unlock_all_caches. */
+static void lock_all_caches(struct KAllocator *ka){
+    pthread_mutex_lock(&ka->cacheListLock);
+    for (struct threadCache *tc = ka->caches; tc != NULL; tc = tc->next){
+        pthread_mutex_lock(&tc->lock);
+        cache_drain(ka, tc);
+    }
+}
+
+static void unlock_all_caches(struct KAllocator *ka){
+    for (struct threadCache *tc = ka->caches; tc != NULL; tc = tc->next){
+        pthread_mutex_unlock(&tc->lock);
+    }
+    pthread_mutex_unlock(&ka->cacheListLock);
+}
+
+
+/* Sets up r to manage the _size bytes at _memory, with no blocks at all;
+ * the caller files the free ones. */
+static void region_init(struct KRegion *r, struct KAllocator *owner, void *_memory, int _size){
+    r->owner = owner;
+    pthread_mutex_init(&r->lock, NULL);
+
+    /* Only use the part of the slice where blocks (or, with tags, their
+     * payloads) start aligned and whose size is a multiple of the
+     * alignment, so that carving blocks keeps every later one aligned. */
+    int skip = alignment_pad(r, _memory, owner->alignment);
+    int usable = (_size > skip) ? (_size - skip) & ~(owner->alignment - 1) : 0;
+    if (has_tags(r) && usable < MIN_TAGGED_BLOCK){
+        usable = 0;
+    }
+    r->size = usable;
+    r->memory = (char*)_memory + skip;
+
+    // Add some other initialization 
+
+    Pool_init(&r->nodePool, sizeof(struct nodeStruct));
+    r->freeBlocks = NULL;
+    r->freeTree = NULL;
+    r->allocatedBlocks = NULL;
+    Index_init(&r->freeIndex);
+    Index_init(&r->allocatedIndex);
+    r->rover = NULL;
+    r->compactCursor = r->memory;
+    r->freeCalls = 0;
+    r->searches = 0;
+    r->searchSteps = 0;
+    r->merges = 0;
+    r->mergeSteps = 0;
+    r->reallocsInPlace = 0;
+    r->reallocsMoved = 0;
+    r->compactMoves = 0;
+    r->compactBytes = 0;
+    r->allocCalls = 0;
+    r->pagesReleased = 0;
+    r->allocatedBytes = 0;
+    r->allocatedChunks = 0;
+    r->allocatedExtent = 0;
+}
+
+static void region_release(struct KRegion *r) {
+    // free other dynamic allocated memory to avoid memory leak
+    /* Every node lives in nodePool, so releasing its slabs frees both
+     * lists at once without walking them. */
+    Pool_destroy(&r->nodePool);
+    r->freeBlocks = NULL;
+    r->allocatedBlocks = NULL;
+    Index_destroy(&r->freeIndex);
+    Index_destroy(&r->allocatedIndex);
+    r->freeTree = NULL;
+    class_reset(r);
+    pthread_mutex_destroy(&r->lock);
+}
+
+/* The last resort for blocks that no region has room for: in a growable
+ * arena, grows the last region until they fit or the arena is as large
+ * as it may get. Returns what region_alloc_run returns. */
+static int grow_and_alloc(struct KAllocator *ka, int _size, int _alignment, int _count, void **_ptrs) {
+    struct KRegion *r = &ka->regions[ka->numRegions - 1];
+    int allocated = 0;
+
+    if (!ka->growable || _size <= 0 || _count <= 0){
+        return 0;
+    }
+
+    /* Another thread may have grown it since this one last looked */
+    pthread_mutex_lock(&r->lock);
+    allocated = region_alloc_run(r, _size, _alignment, _count, _ptrs);
+    while (allocated == 0 && region_grow(r, grow_shortfall(r, _size, _alignment, _count))){
+        allocated = region_alloc_run(r, _size, _alignment, _count, _ptrs);
+    }
+    pthread_mutex_unlock(&r->lock);
+
+    return allocated;
+}
+
+/* How far r, the last region, has to grow for _count blocks of _size
+ * bytes to fit at its end. A free block at the end of the region merges
+ * with the new memory, so it counts towards them. A buddy block needs the
+ * region to reach its size; once it has, growing by the blocks' size is
+ * a guess that region_grow's doubling makes up for. */
+static long grow_shortfall(struct KRegion *r, int _size, int _alignment, int _count) {
+    char *end = (char*)r->memory + r->size;
+    long tail = 0;
+
+    if (is_buddy(r)){
+        long block = 1L << buddy_order((_size < _alignment) ? _alignment : _size);
+        return (r->size < block) ? block - r->size : block * _count;
+    }
+    if (has_tags(r)){
+        unsigned int footer = (r->size > 0) ? read_tag(end - TAG_SIZE) : 0;
+        tail = tag_is_free(footer) ? tag_size(footer) : 0;
+    } else {
+        struct nodeStruct *last = Tree_findBefore(r->freeTree, end, NULL);
+        tail = (last != NULL && (char*)last->ptr + last->size == end) ? last->size : 0;
+    }
+
+    long need = ((long)_size + _alignment + MIN_TAGGED_BLOCK) * _count - tail;
+    return (need > r->owner->alignment) ? need : r->owner->alignment;
+}
+
+/* Extends r, the last region, into the reserved part of the arena by at
+ * least _bytes, and at least by as much as it already has, so a heap
+ * that keeps growing is only extended a logarithmic number of times.
+ * Only the pages the region now reaches are committed. The new memory is
+ * freed into r, merging with a free block at its old end. Returns 0 if
+ * the arena cannot grow by _bytes. */
+static int region_grow(struct KRegion *r, long _bytes) {
+    struct KAllocator *ka = r->owner;
+    long unit = (ka->pageSize > ka->alignment) ? ka->pageSize : ka->alignment;
+    char *end = (char*)r->memory + r->size;
+    long room = (long)((char*)ka->memory + ka->size - end) & ~((long)ka->alignment - 1);
+    long grow = (_bytes > r->size) ? _bytes : r->size;
+
+    grow = (grow + unit - 1) & ~(unit - 1);
+    if (grow > room){
+        grow = room;
+    }
+    if (grow < _bytes || grow <= 0){
+        return 0;
+    }
+
+    long committed = ((long)(end + grow - (char*)ka->memory) + ka->pageUnit - 1) & ~(ka->pageUnit - 1);
+    if (committed > (long)ka->reserved){
+        committed = (long)ka->reserved;
+    }
+    if (committed > ka->committed){
+        if (mprotect((char*)ka->memory + ka->committed, (size_t)(committed - ka->committed), PROT_READ | PROT_WRITE) != 0){
+            return 0;
+        }
+        ka->committed = committed;
+    }
+
+    int oldSize = r->size;
+    r->size += (int)grow;
+    if (is_buddy(r)){
+        /* The old tail that was too small for a buddy block joins in */
+        buddy_release_range(r, oldSize & ~((1 << BUDDY_MIN_ORDER) - 1), r->size);
+    } else if (has_tags(r)){
+        release_tagged_block(r, end, (int)grow);
+    } else {
+        release_block(r, end, (int)grow);
+    }
+    return 1;
+}
+
+/* _alignment is a power of two, at least the allocator's alignment */
+static void* region_alloc(struct KRegion *r, int _size, int _alignment) {
+    void* ptr = NULL;
+
+    region_alloc_run(r, _size, _alignment, 1, &ptr);
+    return ptr;
+}
+
+/* Carves _count blocks of _size bytes, one right after the other, out of a
+ * single free block, with the first one aligned to _alignment, and stores
+ * their addresses in _ptrs. Returns _count, or 0 if no free block is large
+ * enough. Buddy blocks cannot be laid out in a row, so BUDDY allocates them
+ * one by one. */
+static int region_alloc_run(struct KRegion *r, int _size, int _alignment, int _count, void **_ptrs) {
+    int alignment = r->owner->alignment;
+
+    if (_size <= 0 || _size > INT_MAX / 2 - _alignment){
+        return 0;
+    }
+    if (is_buddy(r)){
+        for (int i = 0; i < _count; ++i){
+            _ptrs[i] = buddy_alloc(r, _size, _alignment);
+            if (_ptrs[i] != NULL && ((uintptr_t)_ptrs[i] & (uintptr_t)(_alignment - 1)) != 0){
+                region_free(r, _ptrs[i]);
+                _ptrs[i] = NULL;
+            }
+            if (_ptrs[i] == NULL){
+                while (i > 0){
+                    region_free(r, _ptrs[--i]);
+                }
+                return 0;
+            }
+        }
+        return _count;
+    }
+
+    /* With boundary tags the block also has to hold its header and footer */
+    int need = block_extent(r, has_tags(r) ? _size + MIN_TAGGED_BLOCK : _size);
+    if (need > (INT_MAX / 2) / _count){
+        return 0;
+    }
+
+    /* find_free_block applies the FIRST_FIT/BEST_FIT/WORST_FIT policy
+     * over the size classes rather than over the whole freeBlocks list.
+     * Free blocks start aligned to the allocator's alignment, so a larger
+     * one needs at most _alignment - alignment bytes in front; those are
+     * split off as a free block of their own. */
+    struct nodeStruct *freeNode = find_free_block(r, need * _count + _alignment - alignment);
+
+    if (freeNode != NULL && _alignment > alignment){
+        int pad = alignment_pad(r, freeNode->ptr, _alignment);
+        if (pad > 0){
+            freeNode = split_free_block(r, freeNode, pad);
+        }
+    }
+    if (freeNode == NULL){
+        return 0;
+    }
+
+    /* A leftover too small to carry its own tags goes with the last block */
+    int take = need * _count;
+    if (has_tags(r) && freeNode->size - take < MIN_TAGGED_BLOCK){
+        take = freeNode->size;
+    }
+
+    /* allocate_node shrinks freeNode in place (deleting it once it is
+     * used up), so take it off its class list first and re-file
+     * whatever is left over. Shrinking from the front keeps freeNode
+     * between its neighbours, so address order needs no fixing. */
+    int remaining = freeNode->size - take;
+
+    class_remove(r, freeNode);
+    if (has_tags(r)){
+        Index_remove(&r->freeIndex, freeNode->ptr);
+    } else if (remaining == 0){
+        Tree_remove(&r->freeTree, freeNode);
+    }
+    if (remaining == 0 && r->rover == freeNode){
+        r->rover = freeNode->next;
+    }
+    struct nodeStruct *allocatedNode = allocate_node(&r->nodePool, &r->freeBlocks, &r->allocatedBlocks, freeNode, take);
+    if (remaining > 0){
+        class_insert(r, freeNode);
+        if (has_tags(r)){
+            Index_insert(&r->freeIndex, freeNode);
+            write_tags(freeNode->ptr, remaining, 1);
+        }
+    }
+
+    /* Cut what was taken into the blocks. Each node records what the
+     * caller sees: the payload after the header, and the requested size.
+     * The extent of the whole block is in its header, or else is
+     * block_extent(_size). */
+    char *start = allocatedNode->ptr;
+    for (int i = 0; i < _count; ++i){
+        struct nodeStruct *node = allocatedNode;
+        int extent = (i == _count - 1) ? take - need * (_count - 1) : need;
+
+        if (i > 0){
+            node = List_createNode(&r->nodePool, _size, start);
+            List_insertHead(&r->allocatedBlocks, node);
+        }
+        node->ptr = start;
+        if (has_tags(r)){
+            write_tags(start, extent, 0);
+            node->ptr = (void*)(start + TAG_SIZE);
+        }
+        node->size = _size;
+        node->alignment = (i == 0) ? _alignment : alignment;
+        node->handle = 0;
+        Index_insert(&r->allocatedIndex, node);
+        count_allocated(r, node, 1);
+
+        _ptrs[i] = node->ptr;
+        start += extent;
+    }
+    r->allocCalls += _count;
+    return _count;
+}
+
+static void region_free(struct KRegion *r, void* _ptr) {
+    /* Get the node with poiter _ptr */
+    struct nodeStruct* nodeToKill = Index_find(&r->allocatedIndex, _ptr);
+    assert(nodeToKill != NULL);
+    int size = nodeToKill->size;
+    int order = nodeToKill->order;
+    if (nodeToKill->handle == ROOT_HANDLE){
+        r->owner->persist->root = -1;
+    }
+    count_allocated(r, nodeToKill, -1);
+
+    /* Remove the nodeToKill from the allocatedBlocks list and its index: */
+    Index_remove(&r->allocatedIndex, _ptr);
+    List_deleteNode(&r->nodePool, &r->allocatedBlocks, nodeToKill);
+
+    /* Hand the block back to freeBlocks, coalescing it with its neighbours */
+    compact_restart(r, (char*)_ptr - (has_tags(r) ? TAG_SIZE : 0));
+    if (has_tags(r)){
+        void *blockStart = (void*)((char*)_ptr - TAG_SIZE);
+        release_tagged_block(r, blockStart, tag_size(read_tag(blockStart)));
+    } else if (is_buddy(r)){
+        buddy_free(r, _ptr, order);
+    } else {
+        release_block(r, _ptr, block_extent(r, size));
+    }
+
+    ++r->freeCalls;
+}
+
+/* Frees the _count blocks in _ptrs, which are sorted by address. Each run
+ * of blocks that follow each other in memory goes back to the free blocks
+ * as a single range, so it is merged with its neighbours only once. */
+static void region_free_run(struct KRegion *r, void **_ptrs, int _count) {
+    int lead = has_tags(r) ? TAG_SIZE : 0;
+    int i = 0;
+
+    if (is_buddy(r)){
+        /* Buddies have to be merged one order at a time anyway */
+        for (i = 0; i < _count; ++i){
+            region_free(r, _ptrs[i]);
+        }
+        return;
+    }
+
+    while (i < _count){
+        char *runStart = (char*)_ptrs[i] - lead;
+        int runSize = 0;
+
+        do {
+            struct nodeStruct* nodeToKill = Index_find(&r->allocatedIndex, _ptrs[i]);
+            assert(nodeToKill != NULL);
+            if (nodeToKill->handle == ROOT_HANDLE){
+                r->owner->persist->root = -1;
+            }
+            count_allocated(r, nodeToKill, -1);
+            runSize += has_tags(r) ? tag_size(read_tag((char*)_ptrs[i] - TAG_SIZE)) : block_extent(r, nodeToKill->size);
+
+            Index_remove(&r->allocatedIndex, _ptrs[i]);
+            List_deleteNode(&r->nodePool, &r->allocatedBlocks, nodeToKill);
+            ++i;
+        } while (i < _count && (char*)_ptrs[i] - lead == runStart + runSize);
+
+        compact_restart(r, runStart);
+        if (has_tags(r)){
+            release_tagged_block(r, runStart, runSize);
+        } else {
+            release_block(r, runStart, runSize);
+        }
+    }
+
+    r->freeCalls += _count;
+}
+
+static int compare_ptrs(const void *a, const void *b){
+    uintptr_t x = (uintptr_t)*(void* const*)a;
+    uintptr_t y = (uintptr_t)*(void* const*)b;
+    return (x > y) - (x < y);
+}
+
+/* Makes the allocated block at _ptr hold _size bytes without moving it, if
+ * that can be done. Returns 1 if so, and 0 (leaving the block alone) if it
+ * has to move. Either way *_capacity and *_alignment are set to how many
+ * bytes the block could hold before the call, and its alignment. The
+ * capacity can be more than the node's size: a block handed out again by
+ * a thread cache keeps the size it was first allocated with. */
+static int region_resize(struct KRegion *r, void *_ptr, int _size, int *_capacity, int *_alignment){
+    struct nodeStruct *node = Index_find(&r->allocatedIndex, _ptr);
+    int resized = 0;
+
+    assert(node != NULL);
+    if (is_buddy(r)){
+        *_capacity = 1 << node->order;
+    } else if (has_tags(r)){
+        *_capacity = tag_size(read_tag((char*)_ptr - TAG_SIZE)) - MIN_TAGGED_BLOCK;
+    } else {
+        *_capacity = block_extent(r, node->size);
+    }
+    *_alignment = (node->alignment > r->owner->alignment) ? node->alignment : r->owner->alignment;
+
+    count_allocated(r, node, -1);
+    if (_size <= INT_MAX / 2){
+        compact_restart(r, (char*)_ptr - (has_tags(r) ? TAG_SIZE : 0));
+        if (is_buddy(r)){
+            resized = buddy_resize(r, node, _size);
+        } else if (has_tags(r)){
+            resized = tagged_resize(r, node, _size);
+        } else {
+            resized = list_resize(r, node, _size);
+        }
+    }
+
+    if (resized){
+        node->size = _size;
+        ++r->reallocsInPlace;
+    } else {
+        ++r->reallocsMoved;
+    }
+    count_allocated(r, node, 1);
+    return resized;
+}
+
+/* region_resize without tags: a shrunk block's tail goes back through
+ * release_block, and a block grows by taking the front of the free block
+ * that starts where it ends, found through the address tree. */
+static int list_resize(struct KRegion *r, struct nodeStruct *node, int _size){
+    int oldExtent = block_extent(r, node->size);
+    int newExtent = block_extent(r, _size);
+    char *end = (char*)node->ptr + oldExtent;
+
+    if (newExtent <= oldExtent){
+        if (newExtent < oldExtent){
+            release_block(r, (char*)node->ptr + newExtent, oldExtent - newExtent);
+        }
+        return 1;
+    }
+
+    int grow = newExtent - oldExtent;
+    struct nodeStruct *below = Tree_findBefore(r->freeTree, node->ptr, NULL);
+    struct nodeStruct *after = (below != NULL) ? below->next : r->freeBlocks;
+    if (after == NULL || after->ptr != (void*)end || after->size < grow){
+        return 0;
+    }
+
+    /* As in region_alloc, shrinking after from the front keeps it in place */
+    class_remove(r, after);
+    if (after->size == grow){
+        Tree_remove(&r->freeTree, after);
+        free_list_delete(r, after, after->next);
+    } else {
+        after->ptr = (void*)(end + grow);
+        after->size -= grow;
+        class_insert(r, after);
+    }
+    return 1;
+}
+
+/* region_resize with boundary tags: the header after the block says
+ * whether the next block is free and how big it is. */
+static int tagged_resize(struct KRegion *r, struct nodeStruct *node, int _size){
+    char *start = (char*)node->ptr - TAG_SIZE;
+    int oldExtent = tag_size(read_tag(start));
+    int newExtent = block_extent(r, _size + MIN_TAGGED_BLOCK);
+    char *end = start + oldExtent;
+
+    if (newExtent <= oldExtent){
+        /* A tail too small to carry its own tags stays with the block */
+        if (oldExtent - newExtent >= MIN_TAGGED_BLOCK){
+            write_tags(start, newExtent, 0);
+            release_tagged_block(r, start + newExtent, oldExtent - newExtent);
+        }
+        return 1;
+    }
+
+    int grow = newExtent - oldExtent;
+    if (end == (char*)r->memory + r->size){
+        return 0;
+    }
+    unsigned int header = read_tag(end);
+    if (!tag_is_free(header) || tag_size(header) < grow){
+        return 0;
+    }
+
+    struct nodeStruct *after = Index_find(&r->freeIndex, end);
+    assert(after != NULL);
+    class_remove(r, after);
+    Index_remove(&r->freeIndex, end);
+    if (after->size - grow < MIN_TAGGED_BLOCK){
+        newExtent = oldExtent + after->size;
+        free_list_delete(r, after, after->next);
+    } else {
+        after->ptr = (void*)(end + grow);
+        after->size -= grow;
+        Index_insert(&r->freeIndex, after);
+        write_tags(after->ptr, after->size, 1);
+        class_insert(r, after);
+    }
+    write_tags(start, newExtent, 0);
+    return 1;
+}
+
+/* region_resize in BUDDY mode: a block shrinks by freeing its upper
+ * halves, and grows only if it is the lower half at every order it passes
+ * through and each of those buddies is free and whole. */
+static int buddy_resize(struct KRegion *r, struct nodeStruct *node, int _size){
+    int oldOrder = node->order;
+    int newOrder = buddy_order(_size);
+    int offset = (int)((char*)node->ptr - (char*)r->memory);
+
+    if (newOrder <= oldOrder){
+        while (oldOrder > newOrder){
+            --oldOrder;
+            buddy_insert_free(r, offset + (1 << oldOrder), oldOrder);
+        }
+        node->order = newOrder;
+        return 1;
+    }
+
+    if (newOrder > BUDDY_MAX_ORDER || (offset & ((1 << newOrder) - 1)) != 0 || !buddy_fits(r, offset, newOrder)){
+        return 0;
+    }
+    for (int order = oldOrder; order < newOrder; ++order){
+        struct nodeStruct *buddy = Index_find(&r->freeIndex, (char*)r->memory + offset + (1 << order));
+        if (buddy == NULL || buddy->size != (1 << order)){
+            return 0;
+        }
+    }
+    for (int order = oldOrder; order < newOrder; ++order){
+        struct nodeStruct *buddy = Index_find(&r->freeIndex, (char*)r->memory + offset + (1 << order));
+        class_remove(r, buddy);
+        Index_remove(&r->freeIndex, buddy->ptr);
+        free_list_delete(r, buddy, buddy->next);
+    }
+    node->order = newOrder;
+    return 1;
+}
+
+/* _sizes, if not NULL, receives the size each moved block was asked for,
+ * so kreloc_lookup only translates pointers into what its owner can use,
+ * not into the tags or padding behind it. */
+static int region_compact(struct KRegion *r, void** _before, void** _after, int* _sizes) {
+    int compacted_size = 0;
+
+    // compact allocated memory
+    // update _before, _after and compacted_size
+    
+    /* KENNY: What is the necessary logic, here?
+     * We can simply shove everything in the memory array over to the left, and 
+     * not care about the freeBlocks, because the end result of freeBlocks is 
+     * that it will contain one node with large size.
+     */
+    
+    /* Initialization: */
+    List_sort(&r->allocatedBlocks);
+    struct nodeStruct* current = r->allocatedBlocks;
+    void *endOfMemory = r->memory;
+    void *curptr = NULL;
+    void *curstart = NULL;
+    int cursize = 0;
+    struct nodeStruct *lastFree = NULL;
+    int i = 0;
+
+    /* The free blocks are rebuilt as the allocated ones move */
+    reset_free_blocks(r, r->memory, 0);
+    r->compactCursor = r->memory;
+    
+    /* Above, we have sorted the allocatedBlocks by increasing pointer values. This is so that
+     * when we write data, we write from the RIGHT side of the array to the LEFT side, so we 
+     * never overwrite data. */
+
+    /*printf("\n\nDEBUG: compact_allocation | Calling debug print before the while loop!\n");
+    debug_print(0);*/
+
+    while (current != NULL){
+        /* With boundary tags the whole block, tags included, is moved */
+        curptr = current->ptr;
+        curstart = curptr;
+        cursize = block_extent(r, current->size);
+        if (has_tags(r)){
+            curstart = (void*)((char*)curptr - TAG_SIZE);
+            cursize = tag_size(read_tag(curstart));
+        }
+        /* A buddy block has to land on a multiple of its size (or of its
+         * alignment, if that is larger and krealloc has shrunk it); the
+         * gap this may leave behind it is freed as whole buddy blocks. */
+        if (is_buddy(r)){
+            int offset = (int)((char*)endOfMemory - (char*)r->memory);
+            int source = (int)((char*)curptr - (char*)r->memory);
+            cursize = 1 << current->order;
+            int step = (current->alignment > cursize) ? current->alignment : cursize;
+            int aligned = (offset + step - 1) & ~(step - 1);
+            if (aligned > source){
+                aligned = source;
+            }
+            buddy_release_range(r, offset, aligned);
+            endOfMemory = (void*)((char*)r->memory + aligned);
+        } else if (current->alignment > r->owner->alignment){
+            /* Likewise for a block that asked for a larger alignment */
+            int pad = alignment_pad(r, endOfMemory, current->alignment);
+            if (pad > 0){
+                lastFree = add_free_block(r, lastFree, endOfMemory, pad);
+                endOfMemory = (void*)((char*)endOfMemory + pad);
+            }
+        }
+
+        /* Only blocks that are not already where they belong are copied
+         * and reported. A block may move by less than its own size, so
+         * the copy has to allow for overlap. */
+        if (endOfMemory != curstart){
+            _before[i] = curptr;
+            memmove(endOfMemory, curstart, (size_t) cursize);
+            _after[i] = (void*)((char*)endOfMemory + ((char*)curptr - (char*)curstart));
+            if (_sizes != NULL){
+                _sizes[i] = current->size;
+            }
+            Index_remove(&r->allocatedIndex, curptr);
+            current->ptr = _after[i];
+            Index_insert(&r->allocatedIndex, current);
+            handle_moved(r->owner, current);
+            ++r->compactMoves;
+            r->compactBytes += cursize;
+            ++i;
+        }
+
+        /* Increment endOfMemory so that we don't overwrite our data */
+        endOfMemory = (void*)((char*)endOfMemory + cursize);
+
+        current = current->next;
+    }
+    compacted_size = i;
+
+
+    /* Now we need to re-do the freeBlocks array. Delete it all, and make a new big node.*/
+    int tail = (int)((char*)r->memory + r->size - (char*)endOfMemory);
+    if (is_buddy(r)){
+        buddy_release_range(r, (int)((char*)endOfMemory - (char*)r->memory), r->size);
+    } else if (tail > 0){
+        add_free_block(r, lastFree, endOfMemory, tail);
+    }
+    /* What used to be spread over the arena is now one free tail */
+    release_pages(r, endOfMemory, tail, endOfMemory, (char*)endOfMemory + tail);
+
+    return compacted_size;
+}
+
+/* One step of incremental compaction: takes the first free block at or
+ * after compactCursor and slides the block right after it down into it,
+ * so that the hole moves up (merging with any free block it meets), until
+ * *_moved reaches _maxBytes. At least one block is moved per call if any
+ * can be. A block that cannot move down far enough to keep its alignment
+ * is stepped over. Sets *_done and starts over from the bottom once the
+ * only free block left above the cursor is at the end of the region.
+ * Returns the number of blocks moved. BUDDY blocks have to land on a
+ * multiple of their size, which sliding does not give, so in BUDDY mode a
+ * step compacts the whole region at once. */
+static int region_compact_step(struct KRegion *r, int _maxBytes, int *_moved, void **_before, void **_after, int *_done) {
+    char *memoryEnd = (char*)r->memory + r->size;
+    int lead = has_tags(r) ? TAG_SIZE : 0;
+    int count = 0;
+
+    *_done = 0;
+    if (is_buddy(r)){
+        count = region_compact(r, _before, _after, NULL);
+        *_done = 1;
+        return count;
+    }
+
+    while (count == 0 || *_moved < _maxBytes){
+        /* Find the first free block at or after the cursor */
+        struct nodeStruct *hole = NULL;
+        char *cursor = r->compactCursor;
+        if (has_tags(r)){
+            while (cursor < memoryEnd && !tag_is_free(read_tag(cursor))){
+                cursor += tag_size(read_tag(cursor));
+            }
+            hole = (cursor < memoryEnd) ? Index_find(&r->freeIndex, cursor) : NULL;
+        } else {
+            struct nodeStruct *below = Tree_findBefore(r->freeTree, cursor, NULL);
+            hole = (below != NULL) ? below->next : r->freeBlocks;
+        }
+
+        char *holeStart = (hole != NULL) ? (char*)hole->ptr : memoryEnd;
+        int holeSize = (hole != NULL) ? hole->size : 0;
+        char *blockStart = holeStart + holeSize;
+        if (blockStart >= memoryEnd){
+            /* Nothing left above the last hole */
+            r->compactCursor = r->memory;
+            *_done = 1;
+            break;
+        }
+
+        /* Free blocks are coalesced, so an allocated one follows the hole */
+        struct nodeStruct *node = Index_find(&r->allocatedIndex, blockStart + lead);
+        assert(node != NULL);
+        int extent = has_tags(r) ? tag_size(read_tag(blockStart)) : block_extent(r, node->size);
+        int pad = (node->alignment > r->owner->alignment) ? alignment_pad(r, holeStart, node->alignment) : 0;
+        if (pad >= holeSize){
+            r->compactCursor = blockStart + extent;
+            continue;
+        }
+        if (count > 0 && *_moved + extent > _maxBytes){
+            r->compactCursor = holeStart;
+            break;
+        }
+
+        /* Take the hole out, slide the block down (the two may overlap),
+         * and free what is left of the hole above it */
+        class_remove(r, hole);
+        if (has_tags(r)){
+            Index_remove(&r->freeIndex, holeStart);
+        } else {
+            Tree_remove(&r->freeTree, hole);
+        }
+        free_list_delete(r, hole, hole->next);
+
+        _before[count] = node->ptr;
+        memmove(holeStart + pad, blockStart, (size_t)extent);
+        Index_remove(&r->allocatedIndex, node->ptr);
+        node->ptr = (void*)(holeStart + pad + lead);
+        Index_insert(&r->allocatedIndex, node);
+        handle_moved(r->owner, node);
+        _after[count] = node->ptr;
+
+        if (has_tags(r)){
+            if (pad > 0){
+                release_tagged_block(r, holeStart, pad);
+            }
+            release_tagged_block(r, holeStart + pad + extent, holeSize - pad);
+        } else {
+            if (pad > 0){
+                release_block(r, holeStart, pad);
+            }
+            release_block(r, holeStart + pad + extent, holeSize - pad);
+        }
+
+        r->compactCursor = holeStart + pad + extent;
+        *_moved += extent;
+        ++count;
+        ++r->compactMoves;
+        r->compactBytes += extent;
+    }
+    return count;
+}
+
+/* Called before the block at _start is freed or resized in place. The free
+ * space around it may then merge across compactCursor, and leaves a hole
+ * below it anyway, so the next step starts again from the bottom. */
+static void compact_restart(struct KRegion *r, void *_start){
+    if ((char*)_start <= (char*)r->compactCursor){
+        r->compactCursor = r->memory;
+    }
+}
+
+/* Called with handleLock held whenever compaction moves a block */
+static void handle_moved(struct KAllocator *ka, struct nodeStruct *node){
+    if (node->handle > 0){
+        ka->handles[node->handle].ptr = node->ptr;
+    } else if (node->handle == ROOT_HANDLE){
+        ka->persist->root = (char*)node->ptr - (char*)ka->memory;
+    }
+}
+
+/* Appends a record to ka's trace, if it still has one. The caller holds
+ * traceLock. */
+static void trace_write(struct KAllocator *ka, int _op, int _size, unsigned int _id, int _alignment) {
+    struct ktraceRecord record;
+    double now = now_ns();
+    double nanos = now - ka->traceLast;
+
+    if (ka->trace == NULL){
+        return;
+    }
+    record.op = (unsigned char)_op;
+    record.alignLog2 = (_alignment > ka->alignment) ? (unsigned char)__builtin_ctz((unsigned int)_alignment) : 0;
+    record.reserved = 0;
+    record.size = _size;
+    record.id = _id;
+    record.nanos = (nanos < (double)UINT_MAX) ? (unsigned int)nanos : UINT_MAX;
+    ka->traceLast = now;
+    fwrite(&record, sizeof(record), 1, ka->trace);
+}
+
+/* Records a kalloc (_count 1) or, with _batch, a kalloc_batch of _count
+ * blocks of _size bytes, which returned _ptrs, or failed if _ptrs is NULL.
+ * The blocks get consecutive ids, each set under its region's lock; no
+ * other thread can know of them before the records are written, as the
+ * call has not returned yet. */
+static void trace_alloc(struct KAllocator *ka, void **_ptrs, int _count, int _size, int _alignment, int _batch) {
+    unsigned int firstId = 0;
+
+    pthread_mutex_lock(&ka->traceLock);
+    if (_ptrs != NULL && ka->trace != NULL){
+        firstId = ka->traceNextId + 1;
+        ka->traceNextId += (unsigned int)_count;
+    }
+    pthread_mutex_unlock(&ka->traceLock);
+
+    for (int i = 0; i < _count && firstId != 0; ++i){
+        struct KRegion *r = region_of(ka, _ptrs[i]);
+
+        pthread_mutex_lock(&r->lock);
+        Index_find(&r->allocatedIndex, _ptrs[i])->traceId = firstId + (unsigned int)i;
+        pthread_mutex_unlock(&r->lock);
+    }
+
+    pthread_mutex_lock(&ka->traceLock);
+    if (_batch){
+        trace_write(ka, KTRACE_BATCH, _count, 0, 0);
+    }
+    for (int i = 0; i < _count; ++i){
+        trace_write(ka, KTRACE_ALLOC, _size, (firstId != 0) ? firstId + (unsigned int)i : 0, _alignment);
+    }
+    pthread_mutex_unlock(&ka->traceLock);
+}
+
+/* Records a kfree (_count 1) or, with _batch, a kfree_batch of _ptrs,
+ * before the blocks are actually freed, so that their FREEs are written
+ * before any ALLOC of the same memory. Blocks allocated before the trace
+ * started are left out. The ids are gathered first, so that a batch's
+ * records are written together, without holding a region's lock. */
+static void trace_free(struct KAllocator *ka, void **_ptrs, int _count, int _batch) {
+    unsigned int one = 0;
+    unsigned int *ids = (_count > 1) ? malloc(sizeof(unsigned int) * (size_t)_count) : &one;
+    int traced = 0;
+
+    /* Without room for the ids, the frees are recorded one by one */
+    if (ids == NULL){
+        for (int i = 0; i < _count; ++i){
+            trace_free(ka, _ptrs + i, 1, 0);
+        }
+        return;
+    }
+    for (int i = 0; i < _count; ++i){
+        struct KRegion *r = region_of(ka, _ptrs[i]);
+
+        pthread_mutex_lock(&r->lock);
+        struct nodeStruct *node = Index_find(&r->allocatedIndex, _ptrs[i]);
+        assert(node != NULL);
+        if (node->traceId != 0){
+            ids[traced++] = node->traceId;
+            node->traceId = 0;
+        }
+        pthread_mutex_unlock(&r->lock);
+    }
+
+    pthread_mutex_lock(&ka->traceLock);
+    if (_batch && traced > 0){
+        trace_write(ka, KTRACE_BATCH, traced, 0, 0);
+    }
+    for (int i = 0; i < traced; ++i){
+        trace_write(ka, KTRACE_FREE, 0, ids[i], 0);
+    }
+    pthread_mutex_unlock(&ka->traceLock);
+
+    if (ids != &one){
+        free(ids);
+    }
+}
+
+/* Records a krealloc that moved the block at _before to _after (which may
+ * be the same), before the old block is freed. The id moves with it; a
+ * block that had none, having been allocated before the trace started,
+ * gets one and is recorded as allocated. */
+static void trace_realloc(struct KAllocator *ka, void *_before, void *_after, int _size) {
+    struct KRegion *r = region_of(ka, _before);
+    struct nodeStruct *node = NULL;
+
+    pthread_mutex_lock(&r->lock);
+    node = Index_find(&r->allocatedIndex, _before);
+    unsigned int id = node->traceId;
+    node->traceId = 0;
+    pthread_mutex_unlock(&r->lock);
+
+    r = region_of(ka, _after);
+    pthread_mutex_lock(&r->lock);
+    node = Index_find(&r->allocatedIndex, _after);
+    pthread_mutex_lock(&ka->traceLock);
+    if (ka->trace != NULL){
+        if (id == 0){
+            id = ++ka->traceNextId;
+            trace_write(ka, KTRACE_ALLOC, _size, id, node->alignment);
+        } else {
+            trace_write(ka, KTRACE_REALLOC, _size, id, 0);
+        }
+        node->traceId = id;
+    }
+    pthread_mutex_unlock(&ka->traceLock);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* Records a compaction; the blocks keep their ids in their nodes, so
+ * nothing else has to change */
+static void trace_compact(struct KAllocator *ka, int _op, int _maxBytes) {
+    pthread_mutex_lock(&ka->traceLock);
+    trace_write(ka, _op, _maxBytes, 0, 0);
+    pthread_mutex_unlock(&ka->traceLock);
+}
+
+/* Doubles the handle table and chains the new entries onto freeHandle.
+ * Returns 0 if the table cannot grow. */
+static int grow_handles(struct KAllocator *ka){
+    int numHandles = (ka->numHandles > 0) ? ka->numHandles * 2 : 64;
+    struct handleEntry *handles = realloc(ka->handles, sizeof(struct handleEntry) * (size_t)numHandles);
+
+    if (handles == NULL){
+        return 0;
+    }
+    for (int h = numHandles - 1; h >= ka->numHandles && h > 0; --h){
+        handles[h].ptr = NULL;
+        handles[h].nextFree = ka->freeHandle;
+        ka->freeHandle = h;
+    }
+    ka->handles = handles;
+    ka->numHandles = numHandles;
+    return 1;
+}
+
+/* Reserves ka->reserved bytes of address space for the arena, with no
+ * access, and sets ka->hugePages. With _hugePages the arena is placed on
+ * a huge page boundary, by reserving a huge page more and unmapping the
+ * slack on either side, and marked for transparent huge pages if the OS
+ * has them. Returns NULL if the address space cannot be reserved. */
+static void* map_arena(struct KAllocator *ka, int _hugePages) {
+    int prot = PROT_NONE, mapFlags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    char *memory;
+
+    ka->hugePages = 0;
+    if (!_hugePages || !huge_pages_available()){
+        memory = mmap(NULL, ka->reserved, prot, mapFlags, -1, 0);
+        return (memory == MAP_FAILED) ? NULL : memory;
+    }
+
+    size_t mapped = ka->reserved + HUGE_PAGE_SIZE;
+    char *base = mmap(NULL, mapped, prot, mapFlags, -1, 0);
+    if (base == MAP_FAILED){
+        return NULL;
+    }
+    memory = (char*)(((uintptr_t)base + HUGE_PAGE_SIZE - 1) & ~((uintptr_t)HUGE_PAGE_SIZE - 1));
+    if (memory > base){
+        munmap(base, (size_t)(memory - base));
+    }
+    if (base + mapped > memory + ka->reserved){
+        munmap(memory + ka->reserved, (size_t)(base + mapped - (memory + ka->reserved)));
+    }
+#ifdef MADV_HUGEPAGE
+    ka->hugePages = (madvise(memory, ka->reserved, MADV_HUGEPAGE) == 0);
+#endif
+    return memory;
+}
+
+/* Whether the OS can back memory with transparent huge pages when asked
+ * to: the kernel knows MADV_HUGEPAGE and THP is not switched off */
+static int huge_pages_available(void) {
+#ifdef MADV_HUGEPAGE
+    char mode[128];
+    FILE *f = fopen(THP_ENABLED_PATH, "r");
+    int available = 0;
+
+    if (f != NULL){
+        available = (fgets(mode, sizeof(mode), f) != NULL && strstr(mode, "[never]") == NULL);
+        fclose(f);
+    }
+    return available;
+#else
+    return 0;
+#endif
+}
+
+/* Maps the file at _fd, header and all, shared, so that the arena lives
+ * in the file. Sets ka->persist, and returns the arena or NULL. */
+static void* map_file(struct KAllocator *ka, int _fd) {
+    char *base = mmap(NULL, (size_t)ARENA_ALIGN + (size_t)ka->size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+
+    ka->hugePages = 0;
+    if (base == MAP_FAILED){
+        return NULL;
+    }
+    ka->persist = (struct persistHeader*)base;
+    return base + ARENA_ALIGN;
+}
+
+/* Gives the arena's address space back; a file-backed arena is written
+ * out to its file first. */
+static void unmap_arena(struct KAllocator *ka) {
+    if (ka->persist != NULL){
+        size_t mapped = (size_t)ARENA_ALIGN + (size_t)ka->size;
+
+        msync(ka->persist, mapped, MS_SYNC);
+        munmap(ka->persist, mapped);
+        ka->persist = NULL;
+    } else {
+        munmap(ka->memory, ka->reserved);
+    }
+}
+
+/* FNV-1a over the header's fields from version up to checksum */
+static unsigned int persist_checksum(struct persistHeader *header) {
+    const unsigned char *bytes = (const unsigned char*)header;
+    unsigned int hash = 2166136261u;
+
+    for (size_t i = offsetof(struct persistHeader, version); i < offsetof(struct persistHeader, checksum); ++i){
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/* Whether the header was never written: the magic is the last thing
+ * persist_format writes */
+static int persist_blank(struct persistHeader *header) {
+    for (size_t i = 0; i < sizeof(header->magic); ++i){
+        if (header->magic[i] != 0){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Whether header describes an arena this allocator could have made, in a
+ * file of _fileSize bytes */
+static int persist_header_valid(struct persistHeader *header, long _fileSize) {
+    return memcmp(header->magic, PERSIST_MAGIC, sizeof(header->magic)) == 0
+        && header->version == PERSIST_VERSION
+        && header->checksum == persist_checksum(header)
+        && header->size > 0 && (long)ARENA_ALIGN + header->size == _fileSize
+        && header->aalgorithm >= FIRST_FIT && header->aalgorithm <= NEXT_FIT && header->aalgorithm != BUDDY
+        && (header->flags & KALLOC_BOUNDARY_TAGS) != 0
+        && (header->flags & (KALLOC_THREAD_CACHE | KALLOC_HUGE_PAGES)) == 0
+        && header->numRegions == KALLOC_REGIONS_OF(header->flags) && header->numRegions <= header->size;
+}
+
+/* Writes the header of a new file-backed arena. The free blocks' tags
+ * reach the file before the magic does, so a file whose setup is cut
+ * short reads as blank rather than as a broken heap. */
+static void persist_format(struct KAllocator *ka) {
+    struct persistHeader *header = ka->persist;
+
+    memset(header, 0, sizeof(*header));
+    header->version = PERSIST_VERSION;
+    header->size = ka->size;
+    header->aalgorithm = ka->aalgorithm;
+    header->flags = ka->flags;
+    header->alignment = ka->alignment;
+    header->numRegions = ka->numRegions;
+    header->regionSize = ka->regionSize;
+    header->checksum = persist_checksum(header);
+    header->root = -1;
+    msync(header, (size_t)ARENA_ALIGN + (size_t)ka->size, MS_SYNC);
+    memcpy(header->magic, PERSIST_MAGIC, sizeof(header->magic));
+}
+
+/* Takes over the heap in a file-backed arena's file: checks that it was
+ * laid out the way ka lays it out and that the tags of every region add
+ * up, and only then rebuilds the regions from them. Returns 0 if the file
+ * does not hold a consistent heap. */
+static int persist_attach(struct KAllocator *ka) {
+    struct persistHeader *header = ka->persist;
+    struct nodeStruct *rootNode = NULL;
+
+    if (header->alignment != ka->alignment || header->numRegions != ka->numRegions
+            || header->regionSize != ka->regionSize || header->root < -1 || header->root >= ka->size){
+        return 0;
+    }
+    for (int i = 0; i < ka->numRegions; ++i){
+        if (!region_check_tags(&ka->regions[i])){
+            return 0;
+        }
+    }
+    for (int i = 0; i < ka->numRegions; ++i){
+        region_rebuild(&ka->regions[i]);
+    }
+
+    if (header->root >= 0){
+        void *root = (char*)ka->memory + header->root;
+        rootNode = Index_find(&region_of(ka, root)->allocatedIndex, root);
+        if (rootNode == NULL){
+            return 0;
+        }
+        rootNode->handle = ROOT_HANDLE;
+    }
+    return 1;
+}
+
+/* Frees the blocks of live handles before a file-backed arena is closed;
+ * handles do not outlive the process, so nothing could reach them. */
+static void persist_detach(struct KAllocator *ka) {
+    for (int h = 1; h < ka->numHandles; ++h){
+        if (ka->handles[h].ptr != NULL){
+            khandle_free_from(ka, h);
+        }
+    }
+}
+
+/* Whether r's boundary tags tile it: every block's header and footer
+ * agree, and its size is a multiple of the alignment that ends inside r.
+ * Makes room in allocatedIndex for the allocated blocks on the way. */
+static int region_check_tags(struct KRegion *r) {
+    char *at = r->memory;
+    char *end = at + r->size;
+    int allocated = 0;
+
+    while (at < end){
+        unsigned int tag = read_tag(at);
+        int size = tag_size(tag);
+
+        if (size < MIN_TAGGED_BLOCK || size % r->owner->alignment != 0 || size > end - at
+                || read_tag(at + size - TAG_SIZE) != tag){
+            return 0;
+        }
+        allocated += !tag_is_free(tag);
+        at += size;
+    }
+    Index_reserve(&r->allocatedIndex, allocated);
+    return 1;
+}
+
+/* Files every block of r, as its tags describe it, on r's lists. The size
+ * an allocated block was asked for is not in its tags, so its node gets
+ * the whole capacity, and the largest alignment (up to a page) that its
+ * address has. Free blocks side by side, left by a kfree that was cut
+ * short, are merged. */
+static void region_rebuild(struct KRegion *r) {
+    struct KAllocator *ka = r->owner;
+    struct nodeStruct *lastFree = NULL;
+    char *end = (char*)r->memory + r->size;
     int size;
-    void* memory;
-    // Some other data members you want, 
-    // such as lists to record allocated/free memory
 
-    struct nodeStruct *freeBlocks;
-    struct nodeStruct *allocatedBlocks;
+    for (char *at = r->memory; at < end; at += size){
+        unsigned int tag = read_tag(at);
+        size = tag_size(tag);
 
-};
+        if (!tag_is_free(tag)){
+            struct nodeStruct *node = List_createNode(&r->nodePool, size - MIN_TAGGED_BLOCK, at + TAG_SIZE);
+            uintptr_t offset = (uintptr_t)(at + TAG_SIZE - (char*)ka->memory);
+            int alignment = ka->alignment;
+
+            while (alignment < ka->pageSize && (offset & (uintptr_t)alignment) == 0){
+                alignment <<= 1;
+            }
+            node->alignment = alignment;
+            node->handle = 0;
+            List_insertHead(&r->allocatedBlocks, node);
+            Index_insert(&r->allocatedIndex, node);
+            count_allocated(r, node, 1);
+            lastFree = NULL;
+        } else if (lastFree != NULL){
+            class_remove(r, lastFree);
+            lastFree->size += size;
+            write_tags(lastFree->ptr, lastFree->size, 1);
+            class_insert(r, lastFree);
+        } else {
+            lastFree = add_free_block(r, NULL, at, size);
+        }
+    }
+}
 
-struct KAllocator kallocator;
+/* How much of the first _committed bytes of the arena is in memory */
+static long resident_bytes(struct KAllocator *ka, long _committed) {
+    size_t pages = (size_t)(_committed / ka->pageSize);
+    unsigned char *resident = malloc(pages + 1);
+    long bytes = 0;
 
-void initialize_allocator(int _size, enum allocation_algorithm _aalgorithm) {
+    if (resident != NULL && mincore(ka->memory, (size_t)_committed, resident) == 0){
+        for (size_t i = 0; i < pages; ++i){
+            bytes += (resident[i] & 1) ? ka->pageSize : 0;
+        }
+    }
+    free(resident);
+    return bytes;
+}
+
+/* Adds the sizes of r's blocks and its metadata to stats. */
+static void region_add_stats(struct KRegion *r, struct regionStats *stats) {
+    stats->allocated_size += r->allocatedBytes;
+    stats->allocated_chunks += r->allocatedChunks;
+    if (is_buddy(r)){
+        stats->buddy_block_bytes += r->allocatedExtent;
+    } else {
+        /* With tags, every block's extent includes its header and footer */
+        stats->padding_bytes += r->allocatedExtent - r->allocatedBytes
+                - (has_tags(r) ? (long)MIN_TAGGED_BLOCK * r->allocatedChunks : 0);
+    }
+
+    stats->free_size += r->freeBytes;
+    stats->free_chunks += r->freeChunks;
+    if (r->freeChunks > 0){
+        stats->largest_free_chunk_size = (r->largestFree > stats->largest_free_chunk_size) ? r->largestFree : stats->largest_free_chunk_size;
+        stats->smallest_free_chunk_size = (r->smallestFree < stats->smallest_free_chunk_size) ? r->smallestFree : stats->smallest_free_chunk_size;
+    }
+
+    stats->usable_size += r->size;
+    stats->metadata_bytes += (long)r->nodePool.slabBytes + Index_bytes(&r->freeIndex) + Index_bytes(&r->allocatedIndex);
+    stats->metadata_nodes += r->nodePool.nodesInUse;
+    stats->metadata_mallocs += r->nodePool.mallocCalls + r->freeIndex.mallocCalls + r->allocatedIndex.mallocCalls;
+    stats->free_calls += r->freeCalls;
+    stats->searches += r->searches;
+    stats->search_steps += r->searchSteps;
+    stats->merges += r->merges;
+    stats->merge_steps += r->mergeSteps;
+    stats->reallocs_in_place += r->reallocsInPlace;
+    stats->reallocs_moved += r->reallocsMoved;
+    stats->compact_moves += r->compactMoves;
+    stats->compact_bytes += r->compactBytes;
+    stats->pages_released += r->pagesReleased;
+}
+
+
+
+/* Size class bookkeeping.
+ * The class of a block is floor(log2(size)), and its range within the
+ * class the next TLSF_SL_LOG2 bits of its size, so a request of _size
+ * bytes is satisfied by any block of a non-empty range above the one
+ * _size falls in; within that one, only the blocks from the first that is
+ * big enough up to the tail are. Each range list is kept in order of
+ * size, so both of its ends are at hand. A block is put in its place from
+ * whichever end of the list its size is closer to; blocks of the same
+ * size go to the front. Below TLSF_SL_COUNT times the alignment, every
+ * range holds a single size. */
+static int size_class(int _size){
     assert(_size > 0);
-    kallocator.aalgorithm = _aalgorithm;
-    kallocator.size = _size;
-    kallocator.memory = malloc((size_t)kallocator.size);
+    return 31 - __builtin_clz((unsigned int)_size);
+}
 
-    // Add some other initialization 
+static void class_insert(struct KRegion *r, struct nodeStruct *node){
+    int c = size_class(node->size);
+    int s = size_range(node->size, c);
+    struct nodeStruct **head = &r->rangeLists[c][s];
+    struct nodeStruct **tail = &r->rangeTails[c][s];
+    struct nodeStruct *after = NULL;
+
+    if (*head == NULL || node->size <= (*head)->size){
+        after = NULL;
+    } else if (node->size >= (*tail)->size){
+        after = *tail;
+    } else if (node->size - (*head)->size <= (*tail)->size - node->size){
+        for (after = *head; after->classNext->size < node->size; after = after->classNext){
+        }
+    } else {
+        for (after = *tail; after->size >= node->size; after = after->classPrev){
+        }
+    }
 
-    kallocator.freeBlocks = List_createNode(_size, kallocator.memory);
-    kallocator.allocatedBlocks = NULL;
+    node->classPrev = after;
+    node->classNext = (after != NULL) ? after->classNext : *head;
+    if (node->classNext != NULL){
+        node->classNext->classPrev = node;
+    } else {
+        *tail = node;
+    }
+    if (after != NULL){
+        after->classNext = node;
+    } else {
+        *head = node;
+    }
+    r->classBitmap |= (1u << c);
+    r->rangeBitmaps[c] |= (1u << s);
 
+    STAT_WRITE(r->freeBytes, r->freeBytes + node->size);
+    STAT_WRITE(r->freeChunks, r->freeChunks + 1);
+    find_free_extremes(r);
 }
 
-void destroy_allocator() {
-    free(kallocator.memory);
+static void class_remove(struct KRegion *r, struct nodeStruct *node){
+    int c = size_class(node->size);
+    int s = size_range(node->size, c);
+    struct nodeStruct **head = &r->rangeLists[c][s];
 
-    // free other dynamic allocated memory to avoid memory leak
-    /* deleteAll sets the HEAD pointers to NULL for me, so I don't need to do that. 
-     * I need to make sure they aren't NULL, though, because otherwise the deleteAll function fails. */
-    if (kallocator.freeBlocks != NULL){
-        List_deleteAll(&kallocator.freeBlocks);
+    if (node->classPrev != NULL){
+        node->classPrev->classNext = node->classNext;
+    } else {
+        *head = node->classNext;
+    }
+    if (node->classNext != NULL){
+        node->classNext->classPrev = node->classPrev;
+    } else {
+        r->rangeTails[c][s] = node->classPrev;
     }
-    if (kallocator.allocatedBlocks != NULL){
-        List_deleteAll(&kallocator.allocatedBlocks);
+    node->classNext = NULL;
+    node->classPrev = NULL;
+
+    if (*head == NULL){
+        r->rangeBitmaps[c] &= ~(1u << s);
+        if (r->rangeBitmaps[c] == 0){
+            r->classBitmap &= ~(1u << c);
+        }
     }
+
+    STAT_WRITE(r->freeBytes, r->freeBytes - node->size);
+    STAT_WRITE(r->freeChunks, r->freeChunks - 1);
+    find_free_extremes(r);
 }
 
-void* kalloc(int _size) {
-    void* ptr = NULL;
-    //printf("DEBUG: KALLOC WAS CALLED!\n");
+static void class_reset(struct KRegion *r){
+    memset(r->rangeLists, 0, sizeof(r->rangeLists));
+    memset(r->rangeTails, 0, sizeof(r->rangeTails));
+    memset(r->rangeBitmaps, 0, sizeof(r->rangeBitmaps));
+    r->classBitmap = 0;
+    STAT_WRITE(r->freeBytes, 0);
+    STAT_WRITE(r->freeChunks, 0);
+    find_free_extremes(r);
+}
 
-    // Allocate memory from kallocator.memory 
-    // ptr = address of allocated memory
+/* Sets the largest and smallest free size: the tail of the highest
+ * non-empty range and the head of the lowest, so it takes constant time. */
+static void find_free_extremes(struct KRegion *r){
+    int largest = 0;
+    int smallest = 0;
+
+    if (r->classBitmap != 0){
+        int top = 31 - __builtin_clz(r->classBitmap);
+        int bottom = __builtin_ctz(r->classBitmap);
+        largest = r->rangeTails[top][31 - __builtin_clz(r->rangeBitmaps[top])]->size;
+        smallest = r->rangeLists[bottom][__builtin_ctz(r->rangeBitmaps[bottom])]->size;
+    }
+    STAT_WRITE(r->largestFree, largest);
+    STAT_WRITE(r->smallestFree, smallest);
+}
 
-    if (kallocator.aalgorithm == FIRST_FIT){
-        /* If we use FIRST_FIT, we traverse the freeBlocks to 
-         * find the first block that is large enough. */
-        struct nodeStruct *freeNode = List_findFirstFit(kallocator.freeBlocks, _size );
+/* Adds node's block to r's totals of allocated blocks (_sign 1), or takes
+ * it off them (_sign -1), while its node and tags still describe it */
+static void count_allocated(struct KRegion *r, struct nodeStruct *node, int _sign){
+    int extent = block_extent(r, node->size);
 
-        if (freeNode != NULL){
-            //printf("DEBUG: FIRST Fit returned okay\n");
-            ptr = allocate_node(&kallocator.freeBlocks, &kallocator.allocatedBlocks, freeNode, _size);
-        } else { 
-            //printf("DEBUG: FIRST Fit returned NULL\n");
-            ptr = NULL;
-        }
+    if (is_buddy(r)){
+        extent = 1 << node->order;
+    } else if (has_tags(r)){
+        extent = tag_size(read_tag((char*)node->ptr - TAG_SIZE));
     }
-    else if (kallocator.aalgorithm == BEST_FIT){
-        /* If we use BEST_FIT, we need to traverse freeBlocks so that
-         * we can find the node with size >= _size, but minimally greater. */
-        struct nodeStruct *freeNode = List_findBestFit(kallocator.freeBlocks, _size );
+    STAT_WRITE(r->allocatedBytes, r->allocatedBytes + _sign * node->size);
+    STAT_WRITE(r->allocatedChunks, r->allocatedChunks + _sign);
+    STAT_WRITE(r->allocatedExtent, r->allocatedExtent + _sign * extent);
+}
 
-        if (freeNode != NULL){
-            //printf("DEBUG: BEST Fit returned okay\n");
-            ptr = allocate_node(&kallocator.freeBlocks, &kallocator.allocatedBlocks, freeNode, _size);
-        } else {
-            //printf("DEBUG: BEST Fit returned NULL\n");
-            ptr = NULL;
+/* Returns the lowest non-empty class >= _class, or -1 if there is none. */
+static int next_nonempty_class(struct KRegion *r, int _class){
+    if (_class >= NUM_SIZE_CLASSES){
+        return -1;
+    }
+    unsigned int candidates = r->classBitmap & (~0u << _class);
+    if (candidates == 0){
+        return -1;
+    }
+    return __builtin_ctz(candidates);
+}
+
+/* Picks the free block to carve _size bytes from.
+ * FIRST_FIT takes the first block of the lowest non-empty range above the
+ * one _size falls in (every block there fits), and only if there is none
+ * the largest block of that range. BEST_FIT takes the smallest block that
+ * fits: in the range _size falls in, the blocks too small for it are
+ * passed over, or if none fits, the first block of the lowest non-empty
+ * range above. WORST_FIT takes the tail of the highest non-empty range,
+ * which is the largest free block. No path walks a whole list: the only
+ * walk is BEST_FIT's over the too small blocks of one range, and it never
+ * happens below TLSF_SL_COUNT times the alignment. */
+static struct nodeStruct* find_free_block(struct KRegion *r, int _size){
+    int c = size_class(_size);
+    int s = size_range(_size, c);
+    struct nodeStruct *own = r->rangeLists[c][s];
+    struct nodeStruct *ownTail = r->rangeTails[c][s];
+    struct nodeStruct *ret = NULL;
+
+    if (is_tlsf(r)){
+        return tlsf_find(r, _size);
+    }
+    ++r->searches;
+    if (r->owner->aalgorithm == NEXT_FIT){
+        return next_fit_find(r, _size);
+    }
+
+    ++r->searchSteps;
+    if (r->owner->aalgorithm == WORST_FIT){
+        if (r->classBitmap == 0){
+            return NULL;
         }
+        c = 31 - __builtin_clz(r->classBitmap);
+        ret = r->rangeTails[c][31 - __builtin_clz(r->rangeBitmaps[c])];
+        return (ret->size >= _size) ? ret : NULL;
     }
-    else if (kallocator.aalgorithm == WORST_FIT){
-        /* If we use WORST_FIT, we need to traverse freeBlocks so that 
-         * we can find the node with size >= _size, but maximally greater. */
-        struct nodeStruct *freeNode = List_findWorstFit(kallocator.freeBlocks, _size );
 
-        if (freeNode != NULL){ 
-            //printf("DEBUG: WORST Fit returned okay\n");
-            ptr = allocate_node(&kallocator.freeBlocks, &kallocator.allocatedBlocks, freeNode, _size);
-        } else {
-            //printf("DEBUG: WORST Fit returned NULL\n");
-            ptr = NULL;
+    if (r->owner->aalgorithm == BEST_FIT && ownTail != NULL && ownTail->size >= _size){
+        for (ret = own; ret->size < _size; ret = ret->classNext){
+            ++r->searchSteps;
         }
+        return ret;
+    }
+    ret = lowest_range_head(r, _size);
+    if (ret == NULL && ownTail != NULL && ownTail->size >= _size){
+        ret = ownTail;
     }
+    return ret;
+}
 
-    List_sort(&kallocator.freeBlocks);
+/* Walks freeBlocks from the rover, wrapping around once, and leaves the
+ * rover on the block it returns. */
+static struct nodeStruct* next_fit_find(struct KRegion *r, int _size){
+    struct nodeStruct *start = (r->rover != NULL) ? r->rover : r->freeBlocks;
+    struct nodeStruct *current = start;
 
-    return ptr;
+    if (current == NULL){
+        return NULL;
+    }
+    do {
+        ++r->searchSteps;
+        if (current->size >= _size){
+            r->rover = current;
+            return current;
+        }
+        current = (current->next != NULL) ? current->next : r->freeBlocks;
+    } while (current != start);
+
+    return NULL;
 }
 
-void kfree(void* _ptr) {
-    assert(_ptr != NULL);
+/* Takes node off freeBlocks. If the rover is on it, it moves to
+ * _successor, the block that takes node's place in the walk. */
+static void free_list_delete(struct KRegion *r, struct nodeStruct *node, struct nodeStruct *_successor){
+    if (r->rover == node){
+        r->rover = _successor;
+    }
+    List_deleteNode(&r->nodePool, &r->freeBlocks, node);
+}
 
-    /* My code: */
-    
-    /* Get the node with poiter _ptr */
-    struct nodeStruct* nodeToKill = List_findNode(kallocator.allocatedBlocks, _ptr);
+static int is_tlsf(struct KRegion *r){
+    return r->owner->aalgorithm == TLSF;
+}
 
-    /* Add this metadata to the freeBlocks list */
-    int size = nodeToKill->size;
-    struct nodeStruct* freeNode = List_createNode(size, _ptr);
-    List_insertTail(&kallocator.freeBlocks, freeNode);
+/* Which of the TLSF_SL_COUNT ranges of class _class holds _size: the bits
+ * of _size right below its leading one. */
+static int size_range(int _size, int _class){
+    return (int)((((unsigned long long)_size) << TLSF_SL_LOG2) >> _class) - TLSF_SL_COUNT;
+}
 
-    /* Remove the nodeToKill from the allocatedBlocks list: */
-    List_deleteNode(&kallocator.allocatedBlocks, nodeToKill);
+/* Rounds _size up to the start of the next range, so that any block in
+ * the range it lands in fits, and returns the first block of the lowest
+ * non-empty range at or above it, or NULL if there is none. */
+static struct nodeStruct* lowest_range_head(struct KRegion *r, int _size){
+    int c = size_class(_size);
+    long long rounded = _size;
 
-    /* Coalesce the free block, if possible */
-    List_coalesceNodes(&kallocator.freeBlocks, freeNode);
+    if (c > TLSF_SL_LOG2){
+        rounded += (1LL << (c - TLSF_SL_LOG2)) - 1;
+    }
+    if (rounded > INT_MAX){
+        return NULL;
+    }
+    c = size_class((int)rounded);
 
-    List_sort(&kallocator.freeBlocks);
+    unsigned int ranges = r->rangeBitmaps[c] & (~0u << size_range((int)rounded, c));
+    if (ranges == 0){
+        c = next_nonempty_class(r, c + 1);
+        if (c < 0){
+            return NULL;
+        }
+        ranges = r->rangeBitmaps[c];
+    }
+    return r->rangeLists[c][__builtin_ctz(ranges)];
 }
 
-int compact_allocation(void** _before, void** _after) {
-    int compacted_size = 0;
+/* TLSF takes the first block of the lowest range in which every block
+ * fits. No list is searched. */
+static struct nodeStruct* tlsf_find(struct KRegion *r, int _size){
+    return lowest_range_head(r, _size);
+}
 
-    // compact allocated memory
-    // update _before, _after and compacted_size
-    
-    /* KENNY: What is the necessary logic, here?
-     * We can simply shove everything in the memory array over to the left, and 
-     * not care about the freeBlocks, because the end result of freeBlocks is 
-     * that it will contain one node with large size.
-     */
-    
-    /* Initialization: */
-    List_sort(&kallocator.allocatedBlocks);
-    struct nodeStruct* current = kallocator.allocatedBlocks;
-    void *endOfMemory = kallocator.memory;
-    void *curptr = NULL;
-    int cursize = 0;
-    int totalsize = 0;
-    int i = 0;
-    
-    /* Above, we have sorted the allocatedBlocks by increasing pointer values. This is so that
-     * when we write data, we write from the RIGHT side of the array to the LEFT side, so we 
-     * never overwrite data. */
+/* Returns [_ptr, _ptr + _size) to freeBlocks, merging it with the free
+ * blocks that end right before it and start right after it.
+ * The address tree gives the closest free block below _ptr; its successor on
+ * freeBlocks is the closest one above, so both neighbours are found without
+ * a scan and the list stays in address order. */
+static void release_block(struct KRegion *r, void *_ptr, int _size){
+    void *end = (void*)((char*)_ptr + _size);
+    struct nodeStruct *below = Tree_findBefore(r->freeTree, _ptr, &r->mergeSteps);
+    struct nodeStruct *before = below;
+    struct nodeStruct *after = (below != NULL) ? below->next : r->freeBlocks;
+    struct nodeStruct *freeNode = NULL;
 
-    /*printf("\n\nDEBUG: compact_allocation | Calling debug print before the while loop!\n");
-    debug_print(0);*/
+    ++r->merges;
+    r->mergeSteps += (after != NULL) ? 1 : 0;
+    if (before != NULL && (void*)((char*)before->ptr + before->size) != _ptr){
+        before = NULL;
+    }
+    if (after != NULL && after->ptr != end){
+        after = NULL;
+    }
 
-    while (current != NULL){
-        ++compacted_size;
+    if (before != NULL){
+        /* Grow the block below over the freed one */
+        class_remove(r, before);
+        before->size += _size;
+        freeNode = before;
 
-        cursize = current->size;
-        curptr = current->ptr;
-        totalsize += cursize;
+        if (after != NULL){
+            class_remove(r, after);
+            Tree_remove(&r->freeTree, after);
+            freeNode->size += after->size;
+            free_list_delete(r, after, freeNode);
+        }
+    } else if (after != NULL){
+        /* Grow the block above downwards; it stays above its predecessor,
+         * so its place in the tree does not change. */
+        class_remove(r, after);
+        after->ptr = _ptr;
+        after->size += _size;
+        freeNode = after;
+    } else {
+        /* No free neighbours: insert a new node right after the closest
+         * free block below it (or at the head). */
+        freeNode = List_createNode(&r->nodePool, _size, _ptr);
+        List_insertAfter(&r->freeBlocks, below, freeNode);
+        Tree_insert(&r->freeTree, freeNode);
+    }
 
-        /* Copy the addresses into the before & after arrays: */
-        _before[i] = curptr;
-        _after[i] = memcpy(endOfMemory, curptr, (size_t) cursize);
+    class_insert(r, freeNode);
+    release_pages(r, freeNode->ptr, freeNode->size, _ptr, end);
+}
 
-        /* Update the metadata, too: */
-        current->ptr = _after[i];
 
-        /* Increment endOfMemory so that we don't overwrite our data */
-        endOfMemory = (void*)((char*)endOfMemory + cursize);
+/* Boundary-tag version of release_block.
+ * The footer right before _start and the header right after the block say
+ * whether the physical neighbours are free; their nodes are then found
+ * through freeIndex, so no list is searched. */
+static void release_tagged_block(struct KRegion *r, void *_start, int _size){
+    char *memoryEnd = (char*)r->memory + r->size;
+    void *end = (void*)((char*)_start + _size);
+    struct nodeStruct *before = NULL;
+    struct nodeStruct *after = NULL;
+    struct nodeStruct *freeNode = NULL;
 
-        current = current->next;
-        ++i;
+    ++r->merges;
+    if (_start != r->memory){
+        ++r->mergeSteps;
+        unsigned int footer = read_tag((char*)_start - TAG_SIZE);
+        if (tag_is_free(footer)){
+            before = Index_find(&r->freeIndex, (char*)_start - tag_size(footer));
+            assert(before != NULL);
+        }
+    }
+    if ((char*)end != memoryEnd){
+        ++r->mergeSteps;
+        unsigned int header = read_tag(end);
+        if (tag_is_free(header)){
+            after = Index_find(&r->freeIndex, end);
+            assert(after != NULL);
+        }
+    }
+
+    if (before != NULL){
+        class_remove(r, before);
+        before->size += _size;
+        freeNode = before;
+    } else {
+        freeNode = List_createNode(&r->nodePool, _size, _start);
+        List_insertHead(&r->freeBlocks, freeNode);
+        Index_insert(&r->freeIndex, freeNode);
     }
 
+    if (after != NULL){
+        class_remove(r, after);
+        Index_remove(&r->freeIndex, after->ptr);
+        freeNode->size += after->size;
+        free_list_delete(r, after, freeNode);
+    }
 
-    /* Now we need to re-do the freeBlocks array. Delete it all, and make a new big node.*/
-    if (kallocator.freeBlocks != NULL){
+    write_tags(freeNode->ptr, freeNode->size, 1);
+    class_insert(r, freeNode);
+    release_pages(r, freeNode->ptr, freeNode->size, _start, end);
+}
+
+/* Hands back to the OS the whole pages of the free block at _block that
+ * overlap [_from, _to), the part of it just freed, once the block is
+ * large enough to be worth it. With boundary tags, the block's header and
+ * footer stay. The pages read back as zeros when next touched. */
+static void release_pages(struct KRegion *r, void *_block, int _blockSize, void *_from, void *_to){
+    uintptr_t page = (uintptr_t)r->owner->pageUnit;
+    uintptr_t lead = has_tags(r) ? TAG_SIZE : 0;
+    uintptr_t low = (uintptr_t)_block + lead;
+    uintptr_t high = (uintptr_t)_block + (uintptr_t)_blockSize - lead;
+
+    /* Releasing part of a huge page would split it back into small ones,
+     * and the pages of a file stay in the page cache anyway */
+    if (_blockSize < PAGE_RELEASE_MIN || (uintptr_t)_blockSize < page || r->owner->persist != NULL){
+        return;
+    }
+    low = ((uintptr_t)_from > low) ? (uintptr_t)_from : low;
+    high = ((uintptr_t)_to < high) ? (uintptr_t)_to : high;
+    low = (low + page - 1) & ~(page - 1);
+    high &= ~(page - 1);
+    if (high > low && madvise((void*)low, (size_t)(high - low), MADV_DONTNEED) == 0){
+        r->pagesReleased += (long long)((high - low) / (uintptr_t)r->owner->pageSize);
+    }
+}
+
+/* Drops every free block and makes [_start, _start + _size) the only one. */
+static void reset_free_blocks(struct KRegion *r, void *_start, int _size){
+    if (r->freeBlocks != NULL){
         /* If the free blocks is NULL, this line would error out. */
-        List_deleteAll(&kallocator.freeBlocks);
+        List_deleteAll(&r->nodePool, &r->freeBlocks);
     }
-    if (kallocator.size - totalsize > 0){
+    r->freeTree = NULL;
+    r->rover = NULL;
+    Index_clear(&r->freeIndex);
+    class_reset(r);
+
+    if (is_buddy(r)){
+        int start = (int)((char*)_start - (char*)r->memory);
+        buddy_release_range(r, start, start + _size);
+    } else if (_size > 0){
         /* If the size would be 0, then we don't really need a free node to represent that. */
-        struct nodeStruct* freeNode = List_createNode(kallocator.size - totalsize, endOfMemory);
-        List_insertTail(&kallocator.freeBlocks, freeNode);
+        add_free_block(r, NULL, _start, _size);
     }
-
-    return compacted_size;
 }
 
-int available_memory() {
-    int available_memory_size = 0;
-    // Calculate available memory size
+/* Files [_start, _start + _size) as a free block right after _previous on
+ * freeBlocks (at the head if _previous is NULL), which must keep the list
+ * in address order where that matters. Does not merge. */
+static struct nodeStruct* add_free_block(struct KRegion *r, struct nodeStruct *_previous, void *_start, int _size){
+    struct nodeStruct* freeNode = List_createNode(&r->nodePool, _size, _start);
 
-    struct nodeStruct *current = kallocator.freeBlocks;
-    while (current != NULL){
-        available_memory_size += current->size;
-        current = current->next;
+    List_insertAfter(&r->freeBlocks, _previous, freeNode);
+    if (has_tags(r)){
+        Index_insert(&r->freeIndex, freeNode);
+        write_tags(_start, _size, 1);
+    } else {
+        Tree_insert(&r->freeTree, freeNode);
     }
-    return available_memory_size;
+    class_insert(r, freeNode);
+    return freeNode;
 }
 
-void print_statistics() {
-    int allocated_size = 0;
-    int allocated_chunks = 0;
-    int free_size = 0;
-    int free_chunks = 0;
-    int smallest_free_chunk_size = kallocator.size;
-    int largest_free_chunk_size = 0;
+/* Cuts the free block node in two, leaving its first _front bytes in
+ * node, and returns the node of the rest. */
+static struct nodeStruct* split_free_block(struct KRegion *r, struct nodeStruct *node, int _front){
+    int rest = node->size - _front;
 
-    // Calculate the statistics
-    struct nodeStruct* current = kallocator.allocatedBlocks;
-    while (current != NULL){
-        allocated_size += current->size;
-        ++allocated_chunks;
-        current = current->next;
+    class_remove(r, node);
+    node->size = _front;
+    class_insert(r, node);
+    if (has_tags(r)){
+        write_tags(node->ptr, _front, 1);
     }
+    return add_free_block(r, node, (char*)node->ptr + _front, rest);
+}
 
-    current = kallocator.freeBlocks;
-    while (current != NULL){
-        int curSize = current->size;
+/* The bytes a block of _size takes up: _size rounded up to the alignment */
+static int block_extent(struct KRegion *r, int _size){
+    int alignment = r->owner->alignment;
+    return (_size + alignment - 1) & ~(alignment - 1);
+}
 
-        free_size += curSize;
-        ++free_chunks;
+/* How far a block has to start after _start for its payload to be
+ * aligned to _alignment. When _start is where a block could start, the gap
+ * is a multiple of the allocator's alignment, which with tags is at least
+ * MIN_TAGGED_BLOCK, so it can always be a free block of its own. */
+static int alignment_pad(struct KRegion *r, void *_start, int _alignment){
+    uintptr_t payload = (uintptr_t)_start + (uintptr_t)(has_tags(r) ? TAG_SIZE : 0);
+    return (int)((0 - payload) & (uintptr_t)(_alignment - 1));
+}
 
-        largest_free_chunk_size = (curSize > largest_free_chunk_size) ? curSize : largest_free_chunk_size;
-        smallest_free_chunk_size = (curSize < smallest_free_chunk_size) ? curSize : smallest_free_chunk_size;
+/* Buddy bookkeeping.
+ * Free blocks are filed under their order (a block of 2^k bytes is in
+ * class k, and always in its first range) and indexed by address in
+ * freeIndex. freeBlocks is unordered. An allocated block's order is kept
+ * in its node, as an aligned or shrunk block's size does not give it. */
+static int is_buddy(struct KRegion *r){
+    return r->owner->aalgorithm == BUDDY;
+}
 
-        current = current->next;
+/* The order of the smallest block that holds _size bytes */
+static int buddy_order(int _size){
+    if (_size <= (1 << BUDDY_MIN_ORDER)){
+        return BUDDY_MIN_ORDER;
     }
+    return 32 - __builtin_clz((unsigned int)_size - 1);
+}
+
+/* Whether a block of 2^_order bytes can start at _offset (a multiple of
+ * 2^_order). A region whose size is not a power of two is laid out as
+ * blocks of decreasing size, one per bit of its size, so this holds iff the
+ * block ends before the last multiple of 2^_order in the region. */
+static int buddy_fits(struct KRegion *r, int _offset, int _order){
+    long limit = (long)r->size & ~((1L << _order) - 1);
+    return (long)_offset + (1L << _order) <= limit;
+}
+
+static struct nodeStruct* buddy_insert_free(struct KRegion *r, int _offset, int _order){
+    struct nodeStruct *freeNode = List_createNode(&r->nodePool, 1 << _order, (char*)r->memory + _offset);
+
+    List_insertHead(&r->freeBlocks, freeNode);
+    Index_insert(&r->freeIndex, freeNode);
+    class_insert(r, freeNode);
+    return freeNode;
+}
 
-    printf("Allocated size = %d\n", allocated_size);
-    printf("Allocated chunks = %d\n", allocated_chunks);
-    printf("Free size = %d\n", free_size);
-    printf("Free chunks = %d\n", free_chunks);
-    printf("Largest free chunk size = %d\n", largest_free_chunk_size);
-    printf("Smallest free chunk size = %d\n", smallest_free_chunk_size);
+/* Frees [_start, _end) as the fewest, largest buddy blocks it holds,
+ * each merged with its free buddies, as a grown region's old blocks may
+ * have become buddies of the new ones. _start is a multiple of
+ * 2^BUDDY_MIN_ORDER; a tail too small for a block is left out. */
+static void buddy_release_range(struct KRegion *r, int _start, int _end){
+    while (_end - _start >= (1 << BUDDY_MIN_ORDER)){
+        int order = BUDDY_MIN_ORDER;
 
-    //printf("DEBUG: print_statistics | \n");
+        while (order < BUDDY_MAX_ORDER && (_start & ((2 << order) - 1)) == 0
+                && (long)_start + (2L << order) <= _end && buddy_fits(r, _start, order + 1)){
+            ++order;
+        }
+        buddy_merge(r, _start, order);
+        _start += 1 << order;
+    }
 }
 
+/* Takes the smallest free block of a large enough order and splits off
+ * upper halves until it has the order of the request. A buddy block is
+ * aligned to its own size within the region, so a block asked to be more
+ * aligned than the allocator's alignment is made at least _alignment
+ * bytes; its node keeps the size asked for. */
+static void* buddy_alloc(struct KRegion *r, int _size, int _alignment){
+    int order = buddy_order((_alignment > r->owner->alignment && _size < _alignment) ? _alignment : _size);
+    if (order > BUDDY_MAX_ORDER){
+        return NULL;
+    }
+    int c = next_nonempty_class(r, order);
+    if (c < 0){
+        return NULL;
+    }
 
+    struct nodeStruct *block = r->rangeLists[c][0];
+    void *ptr = block->ptr;
+    class_remove(r, block);
+    Index_remove(&r->freeIndex, ptr);
+    free_list_delete(r, block, block->next);
 
-/* KENNYS STUFF: */
-int get_free_size(){
-    struct nodeStruct *current = kallocator.freeBlocks;
-    int size = 0;
+    int offset = (int)((char*)ptr - (char*)r->memory);
+    while (c > order){
+        --c;
+        buddy_insert_free(r, offset + (1 << c), c);
+    }
 
-    while (current != NULL){
-        size += current->size;
+    struct nodeStruct *allocatedNode = List_createNode(&r->nodePool, _size, ptr);
+    allocatedNode->alignment = _alignment;
+    allocatedNode->order = order;
+    List_insertHead(&r->allocatedBlocks, allocatedNode);
+    Index_insert(&r->allocatedIndex, allocatedNode);
+    count_allocated(r, allocatedNode, 1);
+    return ptr;
+}
+
+/* Merges the free block of 2^_order bytes at _offset with its buddy for
+ * as long as the buddy is free and whole, one order at a time, and files
+ * the result. Returns the merged block. */
+static struct nodeStruct* buddy_merge(struct KRegion *r, int _offset, int _order){
+    int order = _order;
+    int offset = _offset;
+
+    while (order < BUDDY_MAX_ORDER && buddy_fits(r, offset & ~((2 << order) - 1), order + 1)){
+        struct nodeStruct *buddy = Index_find(&r->freeIndex, (char*)r->memory + (offset ^ (1 << order)));
+        if (buddy == NULL || buddy->size != (1 << order)){
+            break;
+        }
+        class_remove(r, buddy);
+        Index_remove(&r->freeIndex, buddy->ptr);
+        free_list_delete(r, buddy, buddy->next);
+
+        offset &= ~(1 << order);
+        ++order;
     }
-    return size;
+    return buddy_insert_free(r, offset, order);
+}
+
+static void buddy_free(struct KRegion *r, void *_ptr, int _order){
+    struct nodeStruct *merged = buddy_merge(r, (int)((char*)_ptr - (char*)r->memory), _order);
+
+    release_pages(r, merged->ptr, merged->size, _ptr, (char*)_ptr + (1 << _order));
+}
+
+static int has_tags(struct KRegion *r){
+    return (r->owner->flags & KALLOC_BOUNDARY_TAGS) != 0;
+}
+
+/* Tags may sit at any byte offset, so they are always accessed through memcpy. */
+static void write_tags(void *_start, int _size, int _free){
+    unsigned int tag = ((unsigned int)_size << 1) | (_free ? 1u : 0u);
+
+    memcpy(_start, &tag, (size_t)TAG_SIZE);
+    memcpy((char*)_start + _size - TAG_SIZE, &tag, (size_t)TAG_SIZE);
+}
+
+static unsigned int read_tag(void *_at){
+    unsigned int tag;
+
+    memcpy(&tag, _at, (size_t)TAG_SIZE);
+    return tag;
 }
 
+static int tag_size(unsigned int _tag){
+    return (int)(_tag >> 1);
+}
+
+static int tag_is_free(unsigned int _tag){
+    return (int)(_tag & 1u);
+}
+
+static double now_ns(void){
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+
+/* KENNYS STUFF: */
+
 
-void debug_print(int selector){
-    struct nodeStruct *freeBlocks = kallocator.freeBlocks;
-    struct nodeStruct *allocBlocks = kallocator.allocatedBlocks;
+static void region_debug_print(struct KRegion *r, int selector){
+    struct nodeStruct *freeBlocks = r->freeBlocks;
+    struct nodeStruct *allocBlocks = r->allocatedBlocks;
 
     struct nodeStruct *current = freeBlocks;
     int i = 0;
@@ -278,3 +3381,133 @@ void debug_print(int selector){
     
     printf("\n\n");
 }
+
+
+
+/* The original API, working on the global allocator: */
+void initialize_allocator(int _size, enum allocation_algorithm _aalgorithm) {
+    initialize_allocator_flags(_size, _aalgorithm, 0);
+}
+
+void initialize_allocator_flags(int _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    int initialized = kallocator_init(&kallocator, _size, _size, _aalgorithm, _flags, -1);
+    assert(initialized);
+    (void)initialized;
+}
+
+void initialize_allocator_growable(int _size, int _maxSize, enum allocation_algorithm _aalgorithm, int _flags) {
+    int initialized = kallocator_init(&kallocator, _size, _maxSize, _aalgorithm, _flags, -1);
+    assert(initialized);
+    (void)initialized;
+}
+
+int initialize_allocator_file(const char *_path, int _size, enum allocation_algorithm _aalgorithm, int _flags) {
+    if (!kallocator_init_file(&kallocator, _path, _size, _aalgorithm, _flags)){
+        return 0;
+    }
+    return kallocator.reattached ? 2 : 1;
+}
+
+void destroy_allocator() {
+    kallocator_release(&kallocator);
+}
+
+void* kalloc(int _size) {
+    return kalloc_from(&kallocator, _size);
+}
+
+void* kalloc_aligned(int _size, int _alignment) {
+    return kalloc_aligned_from(&kallocator, _size, _alignment);
+}
+
+void kfree(void* _ptr) {
+    kfree_to(&kallocator, _ptr);
+}
+
+void* krealloc(void* _ptr, int _size) {
+    return krealloc_from(&kallocator, _ptr, _size);
+}
+
+int kalloc_batch(int _size, int _count, void** _ptrs) {
+    return kalloc_batch_from(&kallocator, _size, _count, _ptrs);
+}
+
+void kfree_batch(void** _ptrs, int _count) {
+    kfree_batch_to(&kallocator, _ptrs, _count);
+}
+
+int khandle_alloc(int _size) {
+    return khandle_alloc_from(&kallocator, _size);
+}
+
+void* khandle_deref(int _handle) {
+    return khandle_deref_from(&kallocator, _handle);
+}
+
+void khandle_free(int _handle) {
+    khandle_free_from(&kallocator, _handle);
+}
+
+int compact_allocation(void** _before, void** _after) {
+    return kallocator_compact(&kallocator, _before, _after);
+}
+
+struct krelocMap* compact_allocation_map(void) {
+    return kallocator_compact_map(&kallocator);
+}
+
+int compact_step(int _maxBytes, void** _before, void** _after, int* _done) {
+    return kallocator_compact_step(&kallocator, _maxBytes, _before, _after, _done);
+}
+
+int start_compactor(double _threshold, void (*_callback)(void*, void*, void*), void* _arg) {
+    return kallocator_start_compactor(&kallocator, _threshold, _callback, _arg);
+}
+
+void stop_compactor(void) {
+    kallocator_stop_compactor(&kallocator);
+}
+
+void kalloc_pin(void) {
+    kallocator_pin(&kallocator);
+}
+
+void kalloc_unpin(void) {
+    kallocator_unpin(&kallocator);
+}
+
+void kalloc_set_root(void* _ptr) {
+    kallocator_set_root(&kallocator, _ptr);
+}
+
+void* kalloc_root(void) {
+    return kallocator_root(&kallocator);
+}
+
+int kalloc_trace_start(const char* _path) {
+    return kallocator_trace_start(&kallocator, _path);
+}
+
+void kalloc_trace_stop(void) {
+    kallocator_trace_stop(&kallocator);
+}
+
+int available_memory() {
+    return kallocator_available_memory(&kallocator);
+}
+
+struct kallocStats get_stats(void) {
+    return kallocator_get_stats(&kallocator);
+}
+
+void print_statistics() {
+    kallocator_print_statistics(&kallocator);
+}
+
+int get_free_size() {
+    return kallocator_get_free_size(&kallocator);
+}
+
+void debug_print(int selector) {
+    kallocator_debug_print(&kallocator, selector);
+}
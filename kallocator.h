@@ -1,22 +1,263 @@
 #ifndef __KALLOCATOR_H__
 #define __KALLOCATOR_H__
 
-enum allocation_algorithm {FIRST_FIT, BEST_FIT, WORST_FIT};
+/* BUDDY rounds every block up to a power of two (16 bytes at least) and
+ * splits and merges blocks in halves, so kalloc and kfree take O(log n)
+ * steps at the cost of internal fragmentation. It ignores
+ * KALLOC_BOUNDARY_TAGS and KALLOC_THREAD_CACHE. */
+/* TLSF (two-level segregated fit) finds a free block with two bitmap
+ * lookups and always uses KALLOC_BOUNDARY_TAGS to merge freed blocks, so
+ * kalloc and kfree take a bounded number of steps whatever the heap holds.
+ * A block may be up to 1/16 larger than the request calls for. */
+/* NEXT_FIT walks the free list from where its last search stopped,
+ * wrapping around at the end, and takes the first block that fits. */
+enum allocation_algorithm {FIRST_FIT, BEST_FIT, WORST_FIT, BUDDY, TLSF, NEXT_FIT};
 
+/* Flags for initialize_allocator_flags. */
+/* Give every block an in-band header and footer (size + free bit), so that
+ * kfree finds and merges both physical neighbours in constant time.
+ * Costs 8 bytes per block; the free lists are then kept only as an index
+ * and are no longer in address order. */
+#define KALLOC_BOUNDARY_TAGS 0x1
+/* Split the arena into n (1 to 255) equally sized regions, each with its
+ * own lock. Threads allocate from different regions and only contend when
+ * they share one, but no block can be larger than a region. The default is
+ * a single region. */
+#define KALLOC_REGIONS(n) (((n) & 0xff) << 8)
+#define KALLOC_REGIONS_OF(flags) ((((flags) >> 8) & 0xff) ? (((flags) >> 8) & 0xff) : 1)
+/* Put a per-thread cache of recently freed blocks of up to 256 bytes in
+ * front of the shared arena, so that small kalloc/kfree pairs do not touch
+ * the regions' locks. Implies KALLOC_BOUNDARY_TAGS, which kfree uses to
+ * read a block's size without a lock. Cached blocks still count as
+ * allocated in the statistics and are returned when their thread exits,
+ * at compaction and when a cache goes over its limits. */
+#define KALLOC_THREAD_CACHE 0x2
+/* Back the arena with transparent huge pages: it is placed on a 2MB
+ * boundary, regions of 2MB or more start on one, and the OS is asked for
+ * huge pages (madvise MADV_HUGEPAGE). Free memory is then only handed
+ * back to the OS in whole huge pages. Where transparent huge pages are
+ * not available the arena silently uses normal pages; print_statistics
+ * says which one it got. */
+#define KALLOC_HUGE_PAGES 0x4
+/* Make kalloc return blocks aligned to 2^k bytes (k from 0 to 12); block
+ * sizes are rounded up to a multiple of the alignment. The default is 8
+ * bytes, which is also the least with KALLOC_BOUNDARY_TAGS. */
+#define KALLOC_ALIGN_LOG2(k) ((((k) + 1) & 0x1f) << 16)
+#define KALLOC_ALIGN_OF(flags) ((((flags) >> 16) & 0x1f) ? 1 << ((((flags) >> 16) & 0x1f) - 1) : 8)
+
+/* The original API works on one global allocator: */
 void initialize_allocator(int _size, enum allocation_algorithm _aalgorithm);
+void initialize_allocator_flags(int _size, enum allocation_algorithm _aalgorithm, int _flags);
+/* Like initialize_allocator_flags, but the arena starts at _size bytes and
+ * grows in place, as kalloc runs out of room, up to _maxSize. Address space
+ * for _maxSize is reserved at once; memory is only committed as the arena
+ * grows, and live blocks never move because of it. With KALLOC_REGIONS
+ * the last region is the one that grows. */
+void initialize_allocator_growable(int _size, int _maxSize, enum allocation_algorithm _aalgorithm, int _flags);
+/* Keeps the arena in the file at _path, mapped shared, so that the heap
+ * outlives the process. A new (or empty) file gets a new arena of _size
+ * bytes, and 1 is returned. A file that holds an arena already is
+ * reattached, and 2 is returned: its size, algorithm and flags come from
+ * the file, the other arguments are ignored, and the blocks that were
+ * allocated are allocated again, at the same offsets in the arena. The
+ * heap is rebuilt from its boundary tags, which are checked on the way; a
+ * file whose tags do not add up (say, after a crash in the middle of a
+ * kfree) is refused rather than used, and 0 is returned, as when the file
+ * cannot be opened. Blocks may come back at another address, so data in
+ * the arena should refer to blocks by offset rather than by pointer, and
+ * the program finds its way in through the root block (see
+ * kalloc_set_root). Always uses KALLOC_BOUNDARY_TAGS; BUDDY is not
+ * supported, the arena does not grow, and KALLOC_THREAD_CACHE and
+ * KALLOC_HUGE_PAGES are ignored. Handles do not outlive the process:
+ * their blocks are freed by destroy_allocator. */
+int initialize_allocator_file(const char *_path, int _size, enum allocation_algorithm _aalgorithm, int _flags);
 
 void* kalloc(int _size);
+/* Returns a block whose address is a multiple of _alignment, a power of
+ * two, or NULL if there is no room (or _alignment is not a power of two).
+ * The bytes skipped to align it stay free. In BUDDY mode the block is
+ * rounded up to at least _alignment bytes, and alignments above 4096 may
+ * fail. Blocks keep their alignment through compaction. */
+void* kalloc_aligned(int _size, int _alignment);
 void kfree(void* _ptr);
+/* Resizes the block at _ptr to _size bytes and returns its address. The
+ * block grows into a free block right after it, or shrinks by freeing its
+ * tail, where it can; otherwise it moves, keeping its alignment. On
+ * failure NULL is returned and the block is left alone. A NULL _ptr is
+ * passed to kalloc; a _size of 0 frees the block and returns NULL. */
+void* krealloc(void* _ptr, int _size);
+/* Allocates _count blocks of _size bytes, storing their addresses in
+ * _ptrs, and returns _count, or 0 (allocating nothing) if they do not all
+ * fit. The blocks are carved side by side out of one free block when there
+ * is one large enough, which costs about as much as a single kalloc. */
+int kalloc_batch(int _size, int _count, void** _ptrs);
+/* Frees the _count blocks in _ptrs, which is sorted by address in the
+ * process. Blocks that lie next to each other are merged into the free
+ * blocks as one. */
+void kfree_batch(void** _ptrs, int _count);
+/* Handles: khandle_alloc returns a handle (a positive int) to a new block
+ * of _size bytes, or 0 if there is no room. khandle_deref gives the
+ * block's current address, which stays valid until the next compaction;
+ * compaction updates the handle itself, so callers holding handles need
+ * not look at _before/_after. A handle's block is released with
+ * khandle_free, never with kfree or krealloc. */
+int khandle_alloc(int _size);
+void* khandle_deref(int _handle);
+void khandle_free(int _handle);
 int available_memory();
 void print_statistics();
+/* The allocator's totals, kept up to date by every kalloc, kfree and
+ * compaction, so that reading them takes constant time and never waits
+ * for a lock. While other threads allocate, the fields may be momentarily
+ * out of step with each other; when none do, they are exact. Blocks held
+ * by thread caches count as allocated, and allocated_size is the sum of
+ * the sizes asked for. smallest_free_chunk_size is 0 when nothing is
+ * free. */
+struct kallocStats {
+    int allocated_size;
+    int allocated_chunks;
+    int free_size;
+    int free_chunks;
+    int largest_free_chunk_size;
+    int smallest_free_chunk_size;
+};
+struct kallocStats get_stats(void);
+/* Slides the allocated blocks down to the start of the arena, leaving the
+ * free memory in one piece (per region, and bar alignment padding). Only
+ * blocks that actually move are copied and reported in _before/_after;
+ * the number of them is returned. print_statistics reports the moves and
+ * bytes copied by all compactions so far. */
 int compact_allocation(void** _before, void** _after);
+/* Compacts like compact_allocation, but returns the moves as a relocation
+ * map, or NULL (without compacting) if the map cannot be allocated.
+ * kreloc_lookup translates a pointer from before the compaction, including
+ * one into the middle of a block, to where it points now, in O(log n); a
+ * pointer into a block that did not move comes back unchanged. The map is
+ * released with kreloc_free. */
+struct krelocMap;
+struct krelocMap* compact_allocation_map(void);
+void* kreloc_lookup(struct krelocMap* map, void* _ptr);
+int kreloc_count(struct krelocMap* map);
+void kreloc_free(struct krelocMap* map);
+/* Compacts a little at a time: moves blocks down until about _maxBytes
+ * have been copied (at least one block, if any can move), reports each
+ * move in _before/_after like compact_allocation, and returns the number
+ * of moves. The arrays must be as large as for compact_allocation. *_done
+ * is set once a step finishes a pass over the whole arena; the next call
+ * starts another one. Between steps the allocator is used as usual, and
+ * blocks freed behind the pass are picked up by the next one. In BUDDY
+ * mode each step compacts one whole region. */
+int compact_step(int _maxBytes, void** _before, void** _after, int* _done);
+/* Starts a thread that compacts the arena in the background, in
+ * compact_steps, whenever the allocator has been idle for a while or the
+ * free memory has become fragmented past _threshold (0 to 1; 1 minus the
+ * largest free block's share of the free memory). Each move is passed to
+ * _callback (which may be NULL) as (before, after, _arg), and handles are
+ * updated as with any compaction. Returns 0 if the thread could not be
+ * started or is already running. kalloc, kfree and the rest may be used
+ * as usual meanwhile; blocks only stay put while the calling thread has
+ * the allocator pinned, between kalloc_pin and kalloc_unpin, so addresses
+ * from khandle_deref should only be used in that window. _callback runs
+ * while nothing is pinned, and must not pin. */
+int start_compactor(double _threshold, void (*_callback)(void*, void*, void*), void* _arg);
+void stop_compactor(void);
+void kalloc_pin(void);
+void kalloc_unpin(void);
+/* The root block of a file-backed arena: kalloc_set_root records _ptr, an
+ * allocated block (or NULL), in the file, and kalloc_root returns it, at
+ * its current address, including after a reattach. Compaction keeps the
+ * root up to date; freeing the root block (which krealloc does when it
+ * moves it) sets the root back to NULL. */
+void kalloc_set_root(void* _ptr);
+void* kalloc_root(void);
+/* Records every kalloc, kalloc_aligned, krealloc, kfree (and their batch
+ * and handle variants), compact_allocation and compact_step (the
+ * background compactor's included) to the file at _path, until
+ * kalloc_trace_stop, so that the same sequence can be played against
+ * another algorithm (see kreplay). Returns 0 if the file cannot be written
+ * or a trace is being recorded already. Blocks are named by an id that
+ * stays with them through krealloc and compaction; frees of blocks
+ * allocated before the trace started are left out, so a trace is best
+ * started right after the allocator is set up. */
+int kalloc_trace_start(const char* _path);
+void kalloc_trace_stop(void);
 void destroy_allocator();
 
+/* A trace file is a ktraceHeader followed by ktraceRecords, in the order
+ * the calls took effect, in the byte order of the machine that wrote it.
+ * ALLOC gives a new block the next id, or id 0 if the kalloc failed;
+ * alignLog2 is the alignment asked of kalloc_aligned (0 for the default).
+ * REALLOC resizes block id to size, wherever it ends up; a failed krealloc
+ * is not recorded. FREE frees block id. COMPACT is a compact_allocation
+ * (or compact_allocation_map), COMPACT_STEP a compact_step with size as
+ * its byte budget. BATCH says that the next size records, all ALLOCs of
+ * one size or all FREEs, are one kalloc_batch or kfree_batch. nanos is the
+ * time since the previous record, or since the trace started, capped at
+ * UINT_MAX. */
+#define KTRACE_MAGIC "KTRACEv1"
+enum ktraceOp {KTRACE_ALLOC, KTRACE_FREE, KTRACE_REALLOC, KTRACE_COMPACT, KTRACE_COMPACT_STEP, KTRACE_BATCH};
+struct ktraceHeader {
+    char magic[8];
+    /* The allocator the trace was recorded on */
+    int size;
+    int aalgorithm;
+    int flags;
+};
+struct ktraceRecord {
+    unsigned char op;
+    unsigned char alignLog2;
+    unsigned short reserved;
+    int size;
+    unsigned int id;
+    unsigned int nanos;
+};
+
 /* KENNYS STUFF: */
 
 int get_free_size(void);
 void debug_print(int selector);
 
+/* Independent allocators, each with its own arena. Every function above
+ * has a counterpart here that works on the allocator it is given.
+ * kallocator_create returns NULL if the arena cannot be allocated.
+ *
+ * kalloc, kfree, compact_allocation and the statistics functions (and their
+ * counterparts) may be called from several threads at once. Creating and
+ * destroying an allocator may not overlap with any other call on it. */
+struct KAllocator;
+
+struct KAllocator* kallocator_create(int _size, enum allocation_algorithm _aalgorithm, int _flags);
+struct KAllocator* kallocator_create_growable(int _size, int _maxSize, enum allocation_algorithm _aalgorithm, int _flags);
+/* Returns NULL if the file cannot be used (see initialize_allocator_file) */
+struct KAllocator* kallocator_open(const char* _path, int _size, enum allocation_algorithm _aalgorithm, int _flags);
+void kallocator_destroy(struct KAllocator* ka);
+
+void* kalloc_from(struct KAllocator* ka, int _size);
+void* kalloc_aligned_from(struct KAllocator* ka, int _size, int _alignment);
+void kfree_to(struct KAllocator* ka, void* _ptr);
+void* krealloc_from(struct KAllocator* ka, void* _ptr, int _size);
+int kalloc_batch_from(struct KAllocator* ka, int _size, int _count, void** _ptrs);
+void kfree_batch_to(struct KAllocator* ka, void** _ptrs, int _count);
+int khandle_alloc_from(struct KAllocator* ka, int _size);
+void* khandle_deref_from(struct KAllocator* ka, int _handle);
+void khandle_free_from(struct KAllocator* ka, int _handle);
+int kallocator_available_memory(struct KAllocator* ka);
+struct kallocStats kallocator_get_stats(struct KAllocator* ka);
+void kallocator_print_statistics(struct KAllocator* ka);
+int kallocator_compact(struct KAllocator* ka, void** _before, void** _after);
+struct krelocMap* kallocator_compact_map(struct KAllocator* ka);
+int kallocator_compact_step(struct KAllocator* ka, int _maxBytes, void** _before, void** _after, int* _done);
+int kallocator_start_compactor(struct KAllocator* ka, double _threshold, void (*_callback)(void*, void*, void*), void* _arg);
+void kallocator_stop_compactor(struct KAllocator* ka);
+void kallocator_pin(struct KAllocator* ka);
+void kallocator_unpin(struct KAllocator* ka);
+void kallocator_set_root(struct KAllocator* ka, void* _ptr);
+void* kallocator_root(struct KAllocator* ka);
+int kallocator_trace_start(struct KAllocator* ka, const char* _path);
+void kallocator_trace_stop(struct KAllocator* ka);
+int kallocator_get_free_size(struct KAllocator* ka);
+void kallocator_debug_print(struct KAllocator* ka, int selector);
+
 
 
 #endif
@@ -5,20 +5,31 @@
 #include <stdio.h>
 #include <limits.h>
 
-static _Bool doSinglePassOnSort(struct nodeStruct **headRef);
-static void swapElements(struct nodeStruct **previous, struct nodeStruct *nodeA, struct nodeStruct *b);
+static struct nodeStruct* mergeSort(struct nodeStruct *head);
+static struct nodeStruct* mergeLists(struct nodeStruct *nodeA, struct nodeStruct *nodeB);
 
 
 /*
- * Allocate memory for a node of type struct nodeStruct and initialize
+ * Take a node of type struct nodeStruct from pool and initialize
  * it with the value size. Return a pointer to the new node.
+ * The pool must hold nodes of sizeof(struct nodeStruct) bytes.
  */
-struct nodeStruct* List_createNode(int size, void *ptr)
+struct nodeStruct* List_createNode(struct nodePool *pool, int size, void *ptr)
 {
-	struct nodeStruct *pNode = malloc(sizeof(struct nodeStruct));
+	struct nodeStruct *pNode = Pool_alloc(pool);
 	if (pNode != NULL) {
 		pNode->size = size;
+        pNode->alignment = 0;
+        pNode->order = 0;
+        pNode->handle = 0;
+        pNode->traceId = 0;
         pNode->ptr = ptr;
+        pNode->next = NULL;
+        pNode->prev = NULL;
+        pNode->classNext = NULL;
+        pNode->classPrev = NULL;
+        pNode->left = NULL;
+        pNode->right = NULL;
 	}
 	return pNode;
 }
@@ -29,6 +40,10 @@ struct nodeStruct* List_createNode(int size, void *ptr)
 void List_insertHead (struct nodeStruct **headRef, struct nodeStruct *node)
 {
 	node->next = *headRef;
+	node->prev = NULL;
+	if (*headRef != NULL) {
+		(*headRef)->prev = node;
+	}
 	*headRef = node;
 }
 
@@ -38,6 +53,7 @@ void List_insertHead (struct nodeStruct **headRef, struct nodeStruct *node)
 void List_insertTail (struct nodeStruct **headRef, struct nodeStruct *node)
 {
 	node->next = NULL;
+	node->prev = NULL;
 
 	// Handle empty list
 	if (*headRef == NULL) {
@@ -50,7 +66,27 @@ void List_insertTail (struct nodeStruct **headRef, struct nodeStruct *node)
 			current = current->next;
 		}
 		current->next = node;
+		node->prev = current;
+	}
+}
+
+/*
+ * Insert node right after previous, or at the head of the list if
+ * previous is NULL.
+ */
+void List_insertAfter (struct nodeStruct **headRef, struct nodeStruct *previous, struct nodeStruct *node)
+{
+	if (previous == NULL) {
+		List_insertHead(headRef, node);
+		return;
 	}
+
+	node->prev = previous;
+	node->next = previous->next;
+	if (previous->next != NULL) {
+		previous->next->prev = node;
+	}
+	previous->next = node;
 }
 
 /*
@@ -84,35 +120,32 @@ struct nodeStruct* List_findNode(struct nodeStruct *head, void *ptr)
 }
 
 /*
- * Delete node from the list and free memory allocated to it.
+ * Delete node from the list and return it to pool.
  * This function assumes that node has been properly set (by for example
  * calling List_findNode()) to a valid node in the list. If the list contains
  * only node, the head of the list should be set to NULL.
  */
-void List_deleteNode (struct nodeStruct **headRef, struct nodeStruct *node)
+void List_deleteNode (struct nodePool *pool, struct nodeStruct **headRef, struct nodeStruct *node)
 {
 	assert(headRef != NULL);
 	assert(*headRef != NULL);
 
-	// Is it the first element?
-	if (*headRef == node) {
-		*headRef = node->next;
+	// Unlink node:
+	if (node->prev != NULL) {
+		assert(node->prev->next == node);
+		node->prev->next = node->next;
 	}
 	else {
-		// Find the previous node:
-		struct nodeStruct *previous = *headRef;
-		while (previous->next != node) {
-			previous = previous->next;
-			assert(previous != NULL);
-		}
-
-		// Unlink node:
-		assert(previous->next == node);
-		previous->next = node->next;
+		// It is the first element
+		assert(*headRef == node);
+		*headRef = node->next;
+	}
+	if (node->next != NULL) {
+		node->next->prev = node->prev;
 	}
 
 	// Free memory:
-	free(node);
+	Pool_free(pool, node);
 }
 
 
@@ -120,29 +153,29 @@ void List_deleteNode (struct nodeStruct **headRef, struct nodeStruct *node)
  * This function is just to remove clutter, because
  * I continually used this same chunk of code over and over. 
  */
-void* allocate_node(struct nodeStruct **freeBlocks, struct nodeStruct **allocatedBlocks, struct nodeStruct *freeNode, int _size){
+struct nodeStruct* allocate_node(struct nodePool *pool, struct nodeStruct **freeBlocks, struct nodeStruct **allocatedBlocks, struct nodeStruct *freeNode, int _size){
     void* ptr = freeNode->ptr;
-    struct nodeStruct *allocatedNode = List_createNode(_size, ptr);
+    struct nodeStruct *allocatedNode = List_createNode(pool, _size, ptr);
 
     /* Decrease the free node's size accordingly */
     freeNode->size -= _size;
     freeNode->ptr = (void*)((char*)freeNode->ptr + _size); 
     if (freeNode->size == 0){ 
-        List_deleteNode(freeBlocks, freeNode);
+        List_deleteNode(pool, freeBlocks, freeNode);
     }   
 
     /* Add the new allocated node to the allocatedBlocks */
     List_insertHead(allocatedBlocks, allocatedNode);
     
-    return ptr;
+    return allocatedNode;
 }
 
 
 
 /* KENNY: ADDED THIS ONE MYSELF!
- * Delete all nodes in the linked list.
+ * Delete all nodes in the linked list, returning them to pool.
  */
-void List_deleteAll(struct nodeStruct **headRef){
+void List_deleteAll(struct nodePool *pool, struct nodeStruct **headRef){
     assert(headRef != NULL);
     assert(*headRef != NULL);
 
@@ -150,7 +183,7 @@ void List_deleteAll(struct nodeStruct **headRef){
 
     while(node != NULL){
         *headRef = node->next;
-        free(node);
+        Pool_free(pool, node);
     
         node = *headRef;
     }
@@ -220,92 +253,58 @@ struct nodeStruct* List_findWorstFit (struct nodeStruct *head, int minSize){
     return ret;
 }
 
-/* KENNY: ADDED THIS ONE MYSELF!
- * Used when kfree() is called. Looks for two things:
-    1). Free nodes w/ pointer = coalescepoint.ptr + coalescepoint.size 
-        (i.e. a pointer right after our memory block)
-    2). Free nodes such that freeNode.ptr + freeNode.size = coalescepoint.ptr
-        (i.e. OUR pointer is right after another person's memory block)
- */
-void List_coalesceNodes(struct nodeStruct **headRef, struct nodeStruct *coalescepoint){
-    struct nodeStruct *current = *headRef;
-    
-    while (current != NULL){
-        /* Checking the first case (above) */
-        if ((void*)((char*)coalescepoint->ptr + coalescepoint->size) == current->ptr){
-            void* ptr = coalescepoint->ptr;
-            int size = coalescepoint->size + current->size;
-            struct nodeStruct *coalescedNode = List_createNode(size, ptr);
-            //printf("DEBUG: CoalesceNodes | for coalescedNode, ptr = %p, size = %d\n", ptr, size);
-            //printf("DEBUG: CoalesceNodes | for coalescePoint, ptr = %p, size = %d\n", coalescepoint->ptr, coalescepoint->size);
-            //printf("DEBUG: CoalesceNodes | for current, ptr = %p, size = %d\n", current->ptr, current->size);
-            List_deleteNode(headRef, current);
-            List_deleteNode(headRef, coalescepoint);
-            List_insertTail(headRef, coalescedNode);
-            coalescepoint = coalescedNode;
-
-            /* Set the coalescepoint to be this new merged node, in case
-             * there is also a case 2 node. */
-            coalescepoint = coalescedNode;
-            current = *headRef;
-        }
-        /* Checking the second case (above) */
-        if ((void*)((char*)current->ptr + current->size) == coalescepoint->ptr){
-            void* ptr = current->ptr;
-            int size = coalescepoint->size + current->size;
-            struct nodeStruct *coalescedNode = List_createNode(size, ptr);
-            List_deleteNode(headRef, current);
-            List_deleteNode(headRef, coalescepoint);
-            List_insertTail(headRef, coalescedNode);
-
-            /* Set the coalescepoint to be this new merged node, in case
-             * there is also a case 1 node. */
-            coalescepoint = coalescedNode;
-            current = *headRef;
-        }   
-
-        current = current->next;
-    }
-}
-
-
 /*
- * Sort the list in ascending order based on the size field.
- * Any sorting algorithm is fine.
+ * Sort the list in ascending order based on the ptr field.
+ * Merge sort, so O(n log n).
  */
 void List_sort (struct nodeStruct **headRef)
 {
-	while (doSinglePassOnSort(headRef)) {
-		// Do nothing: work done in loop condition.
+	*headRef = mergeSort(*headRef);
+
+	// The merge only maintains next, so rebuild the prev links
+	struct nodeStruct *previous = NULL;
+	struct nodeStruct *current = *headRef;
+	while (current != NULL) {
+		current->prev = previous;
+		previous = current;
+		current = current->next;
 	}
 }
-static _Bool doSinglePassOnSort(struct nodeStruct **headRef)
+static struct nodeStruct* mergeSort(struct nodeStruct *head)
 {
-	_Bool didSwap = false;
-	while (*headRef != NULL) {
-		struct nodeStruct *nodeA = *headRef;
-		// If we don't have 2 remaining elements, nothing to swap.
-		if (nodeA->next == NULL) {
-			break;
-		}
-		struct nodeStruct *nodeB = nodeA->next;
-
-		// Swap needed?
-		if (nodeA->ptr > nodeB->ptr){
-			swapElements(headRef, nodeA, nodeB);
-			didSwap = true;
-		}
+	if (head == NULL || head->next == NULL) {
+		return head;
+	}
 
-		// Advance to next elements
-		headRef = &((*headRef)->next);
+	// Split the list in half
+	struct nodeStruct *slow = head;
+	struct nodeStruct *fast = head->next;
+	while (fast != NULL && fast->next != NULL) {
+		slow = slow->next;
+		fast = fast->next->next;
 	}
-	return didSwap;
+	struct nodeStruct *second = slow->next;
+	slow->next = NULL;
+
+	return mergeLists(mergeSort(head), mergeSort(second));
 }
-static void swapElements(struct nodeStruct **previous,
-		struct nodeStruct *nodeA,
-		struct nodeStruct *nodeB)
+static struct nodeStruct* mergeLists(struct nodeStruct *nodeA, struct nodeStruct *nodeB)
 {
-	*previous = nodeB;
-	nodeA->next = nodeB->next;
-	nodeB->next = nodeA;
+	struct nodeStruct merged;
+	struct nodeStruct *tail = &merged;
+
+	while (nodeA != NULL && nodeB != NULL) {
+		if ((char*)nodeB->ptr < (char*)nodeA->ptr) {
+			tail->next = nodeB;
+			nodeB = nodeB->next;
+		}
+		else {
+			tail->next = nodeA;
+			nodeA = nodeA->next;
+		}
+		tail = tail->next;
+	}
+	tail->next = (nodeA != NULL) ? nodeA : nodeB;
+
+	return merged.next;
 }
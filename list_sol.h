@@ -3,17 +3,42 @@
 #ifndef LIST_H_
 #define LIST_H_
 
+#include "node_pool.h"
+
 struct nodeStruct {
     int size;
+    /* The alignment an allocated block was asked for (see kallocator.c) */
+    int alignment;
+    /* The order of an allocated BUDDY block, which may hold more than its
+     * size asks for (see kallocator.c) */
+    int order;
+    /* The handle an allocated block was given by khandle_alloc, or 0
+     * (ROOT_HANDLE for the root block of a file-backed arena) */
+    int handle;
+    /* The id an allocated block goes by in an allocation trace, or 0 if
+     * it was allocated while no trace was being written (see kallocator.c) */
+    unsigned int traceId;
     void* ptr;
     struct nodeStruct *next;
+    struct nodeStruct *prev;
+
+    /* Links for the size-class list a free block is filed under
+     * (see kallocator.c). Unused while the node is not free. */
+    struct nodeStruct *classNext;
+    struct nodeStruct *classPrev;
+
+    /* Children in the address-ordered tree over free blocks
+     * (see addr_tree.h). Unused while the node is not free. */
+    struct nodeStruct *left;
+    struct nodeStruct *right;
 };
 
 /*
- * Allocate memory for a node of type struct nodeStruct and initialize
+ * Take a node of type struct nodeStruct from pool and initialize
  * it with the value size. Return a pointer to the new node.
+ * The pool must hold nodes of sizeof(struct nodeStruct) bytes.
  */
-struct nodeStruct* List_createNode(int size, void *ptr);
+struct nodeStruct* List_createNode(struct nodePool *pool, int size, void *ptr);
 
 /*
  * Insert node at the head of the list.
@@ -25,6 +50,12 @@ void List_insertHead (struct nodeStruct **headRef, struct nodeStruct *node);
  */
 void List_insertTail (struct nodeStruct **headRef, struct nodeStruct *node);
 
+/*
+ * Insert node right after previous, or at the head of the list if
+ * previous is NULL.
+ */
+void List_insertAfter (struct nodeStruct **headRef, struct nodeStruct *previous, struct nodeStruct *node);
+
 /*
  * Count number of nodes in the list.
  * Return 0 if the list is empty, i.e., head == NULL
@@ -37,18 +68,19 @@ int List_countNodes (struct nodeStruct *head);
 struct nodeStruct* List_findNode(struct nodeStruct *head, void *ptr);
 
 /*
- * Delete node from the list and free memory allocated to it.
+ * Delete node from the list and return it to pool.
  * This function assumes that node has been properly set (by for example
  * calling List_findNode()) to a valid node in the list. If the list contains
  * only node, the head of the list should be set to NULL.
+ * Runs in constant time, using the node's prev link.
  */
-void List_deleteNode (struct nodeStruct **headRef, struct nodeStruct *node);
+void List_deleteNode (struct nodePool *pool, struct nodeStruct **headRef, struct nodeStruct *node);
 
 
 
 /*
- * Sort the list in ascending order based on the size field.
- * Any sorting algorithm is fine.
+ * Sort the list in ascending order based on the ptr field.
+ * Merge sort, so O(n log n).
  */
 void List_sort (struct nodeStruct **headRef);
 
@@ -57,9 +89,10 @@ void List_sort (struct nodeStruct **headRef);
 
 /* KENNYS STUFF FOR MEMORY MANAGEMENT PRJ5: */
 /* KENNY: ADDED THIS ONE MYSELF!
- * Delete all nodes in the linked list pointed to by *headRef.
+ * Delete all nodes in the linked list pointed to by *headRef,
+ * returning them to pool.
  */
-void List_deleteAll (struct nodeStruct **headRef);
+void List_deleteAll (struct nodePool *pool, struct nodeStruct **headRef);
 
 /* KENNY: ADDED THIS ONE MYSELF!
  * Used when aalgorithm is FIRST_FIT. Finds the first block that
@@ -79,20 +112,13 @@ struct nodeStruct* List_findBestFit (struct nodeStruct *head, int minSize);
 */
 struct nodeStruct* List_findWorstFit (struct nodeStruct *head, int minSize);
 
-/* KENNY: ADDED THIS ONE MYSELF!
- * Used when kfree() is called. Looks for two things:
- *  1). Free nodes w/ pointer = newNode.ptr + newNode.size 
- *      (i.e. a pointer right after our memory block)
- *  2). Free nodes such that freeNode.ptr + freeNode.size = newNode.ptr
- *      (i.e. OUR pointer is right after another person's memory block)
- */
-void List_coalesceNodes(struct nodeStruct **headRef, struct nodeStruct *coalescepoint);
-
 /* KENNY: ADDED THIS ONE MYSELF!
  * This function is just to remove clutter, because
  * I continually used this same chunk of code over and over.
+ * Carves _size bytes off the front of freeNode and returns the node
+ * recording the new allocation.
  */
-void* allocate_node(struct nodeStruct **freeBlocks, struct nodeStruct **allocatedBlocks, struct nodeStruct *freeNode, int _size);
+struct nodeStruct* allocate_node(struct nodePool *pool, struct nodeStruct **freeBlocks, struct nodeStruct **allocatedBlocks, struct nodeStruct *freeNode, int _size);
 
 
 
@@ -2,10 +2,12 @@
 #include "kallocator.h"
 
 int main(int argc, char* argv[]) {
-    initialize_allocator(100, FIRST_FIT);
-    //initialize_allocator(100, BEST_FIT);
-    //initialize_allocator(100, WORST_FIT);
-    printf("Using first fit algorithm on memory size 100\n");
+    /* Blocks are 8 byte aligned (and so take up at least 8 bytes), so the
+     * arena is large enough for every allocation below to succeed */
+    initialize_allocator(800, FIRST_FIT);
+    //initialize_allocator(800, BEST_FIT);
+    //initialize_allocator(800, WORST_FIT);
+    printf("Using first fit algorithm on memory size 800\n");
 
 
     /* Setting up the p array using kalloc */
@@ -137,5 +139,16 @@ int main(int argc, char* argv[]) {
 
     debug_print(0);
 
+
+    /* A growable arena takes a block nearly as large as it may grow */
+    printf("\n\nTesting a 64KB arena that may grow to 1MB:\n");
+    initialize_allocator_growable(65536, 1 << 20, FIRST_FIT, 0);
+    void* big = kalloc((1 << 20) - 4096);
+    printf("kalloc(%d) %s\n", (1 << 20) - 4096, (big != NULL) ? "succeeded" : "failed");
+    if (big != NULL){
+        kfree(big);
+    }
+    destroy_allocator();
+
     return 0;
 }
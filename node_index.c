@@ -0,0 +1,184 @@
+#include "node_index.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define INITIAL_CAPACITY 64
+
+static unsigned int slotFor(struct nodeIndex *index, void *ptr);
+static void grow(struct nodeIndex *index);
+static void rehash(struct nodeIndex *index, int capacity);
+static void insertSlot(struct nodeIndex *index, void *ptr, struct nodeStruct *node);
+
+
+/*
+ * Initialize an empty index.
+ */
+void Index_init (struct nodeIndex *index)
+{
+    index->capacity = INITIAL_CAPACITY;
+    index->count = 0;
+    index->slots = calloc((size_t)index->capacity, sizeof(struct indexSlot));
+    assert(index->slots != NULL);
+    index->mallocCalls = 1;
+}
+
+/*
+ * Release the memory held by the index. The nodes are not touched.
+ */
+void Index_destroy (struct nodeIndex *index)
+{
+    free(index->slots);
+    index->slots = NULL;
+    index->capacity = 0;
+    index->count = 0;
+}
+
+/*
+ * Remove every entry, keeping the table allocated.
+ */
+void Index_clear (struct nodeIndex *index)
+{
+    memset(index->slots, 0, sizeof(struct indexSlot) * (size_t)index->capacity);
+    index->count = 0;
+}
+
+/*
+ * Bytes held by the table.
+ */
+long Index_bytes (struct nodeIndex *index)
+{
+    return (long)index->capacity * (long)sizeof(struct indexSlot);
+}
+
+/*
+ * Make room for count entries in all, so that inserting them does not
+ * grow the table one doubling at a time.
+ */
+void Index_reserve (struct nodeIndex *index, int count)
+{
+    int capacity = index->capacity;
+
+    while (2 * count > capacity){
+        capacity *= 2;
+    }
+    if (capacity > index->capacity){
+        rehash(index, capacity);
+    }
+}
+
+/*
+ * Add node under its current ptr. No other node may be indexed under that ptr.
+ */
+void Index_insert (struct nodeIndex *index, struct nodeStruct *node)
+{
+    if (2 * (index->count + 1) > index->capacity){
+        grow(index);
+    }
+    insertSlot(index, node->ptr, node);
+}
+
+/*
+ * Return the node indexed under ptr, or NULL if there is none.
+ */
+struct nodeStruct* Index_find (struct nodeIndex *index, void *ptr)
+{
+    unsigned int mask = (unsigned int)index->capacity - 1;
+    unsigned int i = slotFor(index, ptr);
+
+    while (index->slots[i].node != NULL){
+        if (index->slots[i].ptr == ptr){
+            return index->slots[i].node;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/*
+ * Remove the entry for ptr, if any.
+ */
+void Index_remove (struct nodeIndex *index, void *ptr)
+{
+    unsigned int mask = (unsigned int)index->capacity - 1;
+    unsigned int i = slotFor(index, ptr);
+
+    while (index->slots[i].ptr != ptr){
+        if (index->slots[i].node == NULL){
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+
+    /* Backward-shift deletion: pull later entries of the probe run into
+     * the hole unless that would move them before their home slot. */
+    unsigned int hole = i;
+    unsigned int j = i;
+    while (1){
+        j = (j + 1) & mask;
+        if (index->slots[j].node == NULL){
+            break;
+        }
+        unsigned int home = slotFor(index, index->slots[j].ptr);
+        /* Entry j may fill the hole iff its home is not cyclically in (hole, j] */
+        if (((j - home) & mask) >= ((j - hole) & mask)){
+            index->slots[hole] = index->slots[j];
+            hole = j;
+        }
+    }
+    index->slots[hole].ptr = NULL;
+    index->slots[hole].node = NULL;
+    --index->count;
+}
+
+
+/* Home slot of ptr: the address mixed by the splitmix64 finalizer. */
+static unsigned int slotFor(struct nodeIndex *index, void *ptr)
+{
+    unsigned long long x = (unsigned long long)(size_t)ptr;
+
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (unsigned int)x & ((unsigned int)index->capacity - 1);
+}
+
+static void grow(struct nodeIndex *index)
+{
+    rehash(index, index->capacity * 2);
+}
+
+static void rehash(struct nodeIndex *index, int capacity)
+{
+    struct indexSlot *oldSlots = index->slots;
+    int oldCapacity = index->capacity;
+
+    index->capacity = capacity;
+    index->count = 0;
+    index->slots = calloc((size_t)index->capacity, sizeof(struct indexSlot));
+    assert(index->slots != NULL);
+    ++index->mallocCalls;
+
+    for (int i = 0; i < oldCapacity; ++i){
+        if (oldSlots[i].node != NULL){
+            insertSlot(index, oldSlots[i].ptr, oldSlots[i].node);
+        }
+    }
+    free(oldSlots);
+}
+
+static void insertSlot(struct nodeIndex *index, void *ptr, struct nodeStruct *node)
+{
+    unsigned int mask = (unsigned int)index->capacity - 1;
+    unsigned int i = slotFor(index, ptr);
+
+    while (index->slots[i].node != NULL){
+        assert(index->slots[i].ptr != ptr);
+        i = (i + 1) & mask;
+    }
+    index->slots[i].ptr = ptr;
+    index->slots[i].node = node;
+    ++index->count;
+}
@@ -0,0 +1,67 @@
+// Hash index from block address to node.
+
+#ifndef NODE_INDEX_H_
+#define NODE_INDEX_H_
+
+#include "list_sol.h"
+
+/*
+ * Open-addressing hash table (linear probing, backward-shift deletion)
+ * mapping a node's ptr to the node, so that a block can be found from the
+ * pointer handed out by kalloc in constant expected time.
+ * The table doubles whenever it becomes half full.
+ */
+struct indexSlot {
+    void *ptr;
+    struct nodeStruct *node;
+};
+
+struct nodeIndex {
+    struct indexSlot *slots;
+    int capacity;
+    int count;
+    long mallocCalls;
+};
+
+/*
+ * Initialize an empty index.
+ */
+void Index_init (struct nodeIndex *index);
+
+/*
+ * Release the memory held by the index. The nodes are not touched.
+ */
+void Index_destroy (struct nodeIndex *index);
+
+/*
+ * Remove every entry, keeping the table allocated.
+ */
+void Index_clear (struct nodeIndex *index);
+
+/*
+ * Bytes held by the table.
+ */
+long Index_bytes (struct nodeIndex *index);
+
+/*
+ * Make room for count entries in all, so that inserting them does not
+ * grow the table one doubling at a time.
+ */
+void Index_reserve (struct nodeIndex *index, int count);
+
+/*
+ * Add node under its current ptr. No other node may be indexed under that ptr.
+ */
+void Index_insert (struct nodeIndex *index, struct nodeStruct *node);
+
+/*
+ * Return the node indexed under ptr, or NULL if there is none.
+ */
+struct nodeStruct* Index_find (struct nodeIndex *index, void *ptr);
+
+/*
+ * Remove the entry for ptr, if any.
+ */
+void Index_remove (struct nodeIndex *index, void *ptr);
+
+#endif
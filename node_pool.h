@@ -0,0 +1,61 @@
+// Slab pool for list nodes.
+
+#ifndef NODE_POOL_H_
+#define NODE_POOL_H_
+
+#include <stddef.h>
+
+/*
+ * Hands out fixed-size nodes carved from slabs that are malloc'd on demand,
+ * each twice as large as the last (up to POOL_MAX_SLAB_NODES nodes).
+ * Freed nodes go on an intrusive free list and are reused before any new
+ * slab is allocated, so a workload that keeps a steady number of nodes
+ * stops calling malloc once the pool has grown to fit it.
+ */
+#define POOL_FIRST_SLAB_NODES 64
+#define POOL_MAX_SLAB_NODES 65536
+
+struct poolSlab;
+struct poolFreeNode;
+
+struct nodePool {
+    size_t nodeSize;
+    int nodesPerSlab;
+    struct poolSlab *slabs;
+    struct poolFreeNode *freeNodes;
+
+    /* Counters */
+    size_t slabBytes;
+    long nodesInUse;
+    long mallocCalls;
+};
+
+/*
+ * Static initializer for a pool of nodes of nodeSize bytes;
+ * equivalent to calling Pool_init.
+ */
+#define NODE_POOL_INITIALIZER(nodeSize) { (nodeSize), POOL_FIRST_SLAB_NODES, NULL, NULL, 0, 0, 0 }
+
+/*
+ * Initialize an empty pool of nodes of nodeSize bytes.
+ */
+void Pool_init (struct nodePool *pool, size_t nodeSize);
+
+/*
+ * Return an uninitialized node, or NULL if a new slab was needed and
+ * malloc failed.
+ */
+void* Pool_alloc (struct nodePool *pool);
+
+/*
+ * Return node, which must have come from this pool, to the pool.
+ */
+void Pool_free (struct nodePool *pool, void *node);
+
+/*
+ * Free every slab, and with them every node handed out by the pool.
+ * The pool is left empty and can be used again.
+ */
+void Pool_destroy (struct nodePool *pool);
+
+#endif
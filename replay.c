@@ -0,0 +1,349 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "kallocator.h"
+
+/* Replays an allocation trace (see kalloc_trace_start) against the
+ * allocation algorithms and compares them.
+ * Run "kreplay <trace> [algorithm] [arena size]" to replay it against one
+ * algorithm, or against all of them if none is given. The arena size and
+ * flags default to those of the allocator the trace was recorded on. */
+
+static const char *algorithmNames[] = {"first_fit", "best_fit", "worst_fit", "buddy", "tlsf", "next_fit"};
+#define NUM_ALGORITHMS ((int)(sizeof(algorithmNames) / sizeof(algorithmNames[0])))
+
+struct trace {
+    struct ktraceHeader header;
+    struct ktraceRecord *records;
+    long count;
+    /* The highest block id in the trace */
+    unsigned int maxId;
+};
+
+struct replayResult {
+    double seconds;
+    double peakFragmentation;
+    long failed;
+    int peakAllocated;
+};
+
+/* A block that compaction may move, for finding it again by address */
+struct liveBlock {
+    void *ptr;
+    unsigned int id;
+};
+
+/* The live blocks, hashed by address with linear probing, so a compaction
+ * finds the ids of the blocks it moved without looking at the others */
+struct liveTable {
+    struct liveBlock *slots;
+    size_t mask;
+};
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+/* Reads the trace at _path into t. Returns 0 (having said why) if it
+ * cannot be read or is not a trace. */
+static int load_trace(const char *_path, struct trace *t){
+    FILE *file = fopen(_path, "rb");
+    long bytes = 0;
+
+    if (file == NULL){
+        printf("Cannot open %s\n", _path);
+        return 0;
+    }
+    if (fread(&t->header, sizeof(t->header), 1, file) != 1
+            || memcmp(t->header.magic, KTRACE_MAGIC, sizeof(t->header.magic)) != 0){
+        printf("%s is not an allocation trace\n", _path);
+        fclose(file);
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    bytes = ftell(file) - (long)sizeof(t->header);
+    fseek(file, (long)sizeof(t->header), SEEK_SET);
+
+    /* A trace that was cut short ends in part of a record, which is left out */
+    t->count = bytes / (long)sizeof(struct ktraceRecord);
+    t->records = malloc(sizeof(struct ktraceRecord) * (size_t)(t->count > 0 ? t->count : 1));
+    if (t->records == NULL || fread(t->records, sizeof(struct ktraceRecord), (size_t)t->count, file) != (size_t)t->count){
+        printf("Cannot read %s\n", _path);
+        free(t->records);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+
+    t->maxId = 0;
+    for (long i = 0; i < t->count; ++i){
+        t->maxId = (t->records[i].id > t->maxId) ? t->records[i].id : t->maxId;
+    }
+    return 1;
+}
+
+/* Makes room for _count blocks at no more than half full */
+static void live_init(struct liveTable *live, size_t _count){
+    size_t size = 16;
+
+    while (size < 2 * _count){
+        size *= 2;
+    }
+    live->slots = calloc(size, sizeof(struct liveBlock));
+    live->mask = size - 1;
+}
+
+static size_t live_slot(struct liveTable *live, void *_ptr){
+    return (size_t)(((uint64_t)(uintptr_t)_ptr >> 3) * 0x9E3779B97F4A7C15ull >> 32) & live->mask;
+}
+
+static void live_insert(struct liveTable *live, void *_ptr, unsigned int _id){
+    size_t i = live_slot(live, _ptr);
+
+    while (live->slots[i].ptr != NULL){
+        i = (i + 1) & live->mask;
+    }
+    live->slots[i].ptr = _ptr;
+    live->slots[i].id = _id;
+}
+
+/* Takes _ptr out of the table and returns its id, or 0 if it is not in
+ * it. The blocks after it in its run move back so none is cut off. */
+static unsigned int live_remove(struct liveTable *live, void *_ptr){
+    size_t i = live_slot(live, _ptr);
+    unsigned int id = 0;
+
+    while (live->slots[i].ptr != _ptr){
+        if (live->slots[i].ptr == NULL){
+            return 0;
+        }
+        i = (i + 1) & live->mask;
+    }
+    id = live->slots[i].id;
+
+    for (size_t j = (i + 1) & live->mask; live->slots[j].ptr != NULL; j = (j + 1) & live->mask){
+        size_t home = live_slot(live, live->slots[j].ptr);
+        /* The block at j may fill the gap at i if its home is not in (i, j] */
+        if (((j - home) & live->mask) >= ((j - i) & live->mask)){
+            live->slots[i] = live->slots[j];
+            i = j;
+        }
+    }
+    live->slots[i].ptr = NULL;
+    return id;
+}
+
+/* Points block id at _ptr (NULL once it is freed) */
+static void track(void **blocks, struct liveTable *live, unsigned int _id, void *_ptr){
+    if (blocks[_id] != NULL){
+        live_remove(live, blocks[_id]);
+    }
+    blocks[_id] = _ptr;
+    if (_ptr != NULL){
+        live_insert(live, _ptr, _id);
+    }
+}
+
+/* Points blocks at where a compaction moved them. All the moved blocks are
+ * taken out before any is put back, as one may move to where another was. */
+static void relocate(void **blocks, struct liveTable *live, unsigned int *ids, void **before, void **after, int moves){
+    for (int i = 0; i < moves; ++i){
+        ids[i] = live_remove(live, before[i]);
+    }
+    for (int i = 0; i < moves; ++i){
+        if (ids[i] != 0){
+            blocks[ids[i]] = after[i];
+            live_insert(live, after[i], ids[i]);
+        }
+    }
+}
+
+/* Plays the _count records of a batch, at _records, on the allocator */
+static void replay_batch(struct ktraceRecord *_records, int _count, void **blocks, struct liveTable *live, struct replayResult *result){
+    void **ptrs = malloc(sizeof(void*) * (size_t)_count);
+    int n = 0;
+
+    if (ptrs == NULL){
+        printf("Out of memory for a batch of %d\n", _count);
+        exit(1);
+    }
+    if (_records[0].op == KTRACE_ALLOC){
+        if (kalloc_batch(_records[0].size, _count, ptrs) == 0){
+            result->failed += _count;
+        } else if (_records[0].id == 0){
+            kfree_batch(ptrs, _count);
+        } else {
+            for (int i = 0; i < _count; ++i){
+                track(blocks, live, _records[i].id, ptrs[i]);
+            }
+        }
+    } else {
+        for (int i = 0; i < _count; ++i){
+            if (blocks[_records[i].id] != NULL){
+                ptrs[n++] = blocks[_records[i].id];
+                track(blocks, live, _records[i].id, NULL);
+            }
+        }
+        kfree_batch(ptrs, n);
+    }
+    free(ptrs);
+}
+
+/* Plays t against _aalgorithm on an arena of _size bytes. With _measure,
+ * the statistics are read after every call to find the peaks, which is
+ * left out of the timed run. */
+static void replay(struct trace *t, enum allocation_algorithm _aalgorithm, int _size, int _measure, struct replayResult *result){
+    size_t slots = (size_t)t->maxId + 1;
+    void **blocks = calloc(slots, sizeof(void*));
+    void **before = malloc(sizeof(void*) * slots);
+    void **after = malloc(sizeof(void*) * slots);
+    unsigned int *ids = malloc(sizeof(unsigned int) * slots);
+    struct liveTable live;
+
+    live_init(&live, slots);
+    memset(result, 0, sizeof(*result));
+    if (blocks == NULL || before == NULL || after == NULL || ids == NULL || live.slots == NULL){
+        printf("Out of memory for %u blocks\n", t->maxId);
+        exit(1);
+    }
+
+    initialize_allocator_flags(_size, _aalgorithm, t->header.flags);
+    double t0 = now_ns();
+    for (long i = 0; i < t->count; ++i){
+        struct ktraceRecord *record = &t->records[i];
+        void *ptr = NULL;
+        int moves = 0;
+        int done = 0;
+
+        switch (record->op){
+        case KTRACE_ALLOC:
+            ptr = (record->alignLog2 > 0) ? kalloc_aligned(record->size, 1 << record->alignLog2) : kalloc(record->size);
+            if (ptr == NULL){
+                ++result->failed;
+            } else if (record->id == 0){
+                /* It failed when the trace was recorded, so the program
+                 * never used or freed it */
+                kfree(ptr);
+            } else {
+                track(blocks, &live, record->id, ptr);
+            }
+            break;
+        case KTRACE_FREE:
+            if (blocks[record->id] != NULL){
+                kfree(blocks[record->id]);
+                track(blocks, &live, record->id, NULL);
+            }
+            break;
+        case KTRACE_REALLOC:
+            /* A block whose kalloc failed here is allocated now instead.
+             * A size of 0 frees it. */
+            ptr = krealloc(blocks[record->id], record->size);
+            if (ptr != NULL || record->size == 0){
+                track(blocks, &live, record->id, ptr);
+            } else {
+                ++result->failed;
+            }
+            break;
+        case KTRACE_COMPACT:
+            moves = compact_allocation(before, after);
+            relocate(blocks, &live, ids, before, after, moves);
+            break;
+        case KTRACE_COMPACT_STEP:
+            moves = compact_step(record->size, before, after, &done);
+            relocate(blocks, &live, ids, before, after, moves);
+            break;
+        case KTRACE_BATCH:
+            /* A batch cut short at the end of the trace is left out */
+            if (record->size > 0 && record->size <= t->count - i - 1){
+                replay_batch(record + 1, record->size, blocks, &live, result);
+            }
+            i += (record->size > 0) ? record->size : 0;
+            break;
+        }
+
+        if (_measure){
+            struct kallocStats stats = get_stats();
+            double fragmentation = (stats.free_size > 0) ? 1.0 - (double)stats.largest_free_chunk_size / (double)stats.free_size : 0.0;
+
+            result->peakFragmentation = (fragmentation > result->peakFragmentation) ? fragmentation : result->peakFragmentation;
+            result->peakAllocated = (stats.allocated_size > result->peakAllocated) ? stats.allocated_size : result->peakAllocated;
+        }
+    }
+    result->seconds = (now_ns() - t0) / 1e9;
+    destroy_allocator();
+
+    free(blocks);
+    free(before);
+    free(after);
+    free(ids);
+    free(live.slots);
+}
+
+int main(int argc, char* argv[]) {
+    struct trace t;
+    long counts[KTRACE_BATCH + 1] = {0};
+    long failedWhenRecorded = 0;
+    double recordedNs = 0;
+    int first = 0;
+    int last = NUM_ALGORITHMS - 1;
+
+    if (argc < 2 || argc > 4){
+        printf("Usage: %s <trace> [algorithm] [arena size]\n", argv[0]);
+        return 1;
+    }
+    if (!load_trace(argv[1], &t)){
+        return 1;
+    }
+    if (argc >= 3){
+        while (first < NUM_ALGORITHMS && strcmp(argv[2], algorithmNames[first]) != 0){
+            ++first;
+        }
+        if (first == NUM_ALGORITHMS){
+            printf("Unknown algorithm %s. Available:\n", argv[2]);
+            for (int i = 0; i < NUM_ALGORITHMS; ++i){
+                printf("  %s\n", algorithmNames[i]);
+            }
+            return 1;
+        }
+        last = first;
+    }
+    int size = (argc >= 4) ? atoi(argv[3]) : t.header.size;
+    if (size <= 0){
+        printf("Bad arena size %s\n", argv[3]);
+        return 1;
+    }
+
+    for (long i = 0; i < t.count; ++i){
+        if (t.records[i].op <= KTRACE_BATCH){
+            ++counts[t.records[i].op];
+        }
+        failedWhenRecorded += (t.records[i].op == KTRACE_ALLOC && t.records[i].id == 0);
+        recordedNs += t.records[i].nanos;
+    }
+    printf("%s: %ld records over %.3f s (%ld allocations, %ld frees, %ld reallocations, %ld compactions, %ld batches)\n",
+            argv[1], t.count, recordedNs / 1e9, counts[KTRACE_ALLOC], counts[KTRACE_FREE], counts[KTRACE_REALLOC],
+            counts[KTRACE_COMPACT] + counts[KTRACE_COMPACT_STEP], counts[KTRACE_BATCH]);
+    printf("recorded on %s with a %d byte arena, %ld failed allocations\n",
+            (t.header.aalgorithm >= 0 && t.header.aalgorithm < NUM_ALGORITHMS) ? algorithmNames[t.header.aalgorithm] : "?",
+            t.header.size, failedWhenRecorded);
+    printf("replayed on a %d byte arena:\n", size);
+    printf("%10s %14s %18s %14s %16s\n", "algorithm", "Mrecords/s", "peak fragment. %", "failed", "peak allocated");
+
+    for (int algo = first; algo <= last; ++algo){
+        struct replayResult timed;
+        struct replayResult measured;
+
+        replay(&t, (enum allocation_algorithm)algo, size, 0, &timed);
+        replay(&t, (enum allocation_algorithm)algo, size, 1, &measured);
+        printf("%10s %14.2f %18.1f %14ld %16d\n", algorithmNames[algo],
+                (timed.seconds > 0) ? t.count / timed.seconds / 1e6 : 0.0,
+                100.0 * measured.peakFragmentation, timed.failed, measured.peakAllocated);
+    }
+
+    free(t.records);
+    return 0;
+}
@@ -0,0 +1,232 @@
+/* Allocator tests. Run "ktest"; it stops at the first failed assert.
+ * kallocator.c is built in, so that the statistics can be checked against
+ * the regions' own lists. */
+#include <assert.h>
+#include "kallocator.c"
+
+#define NUM_ALGORITHMS 6
+#define TEST_BLOCKS 200
+
+static const int testFlags[] = {0, KALLOC_BOUNDARY_TAGS, KALLOC_REGIONS(3)};
+#define NUM_TEST_FLAGS ((int)(sizeof(testFlags) / sizeof(testFlags[0])))
+
+
+/* Asserts that kallocator_get_stats agrees with a walk of every region's
+ * allocated and free lists. */
+static void check_stats(struct KAllocator *ka){
+    struct kallocStats stats = kallocator_get_stats(ka);
+    int allocatedSize = 0;
+    int allocatedChunks = 0;
+    int freeSize = 0;
+    int freeChunks = 0;
+    int largest = 0;
+    int smallest = 0;
+
+    for (int i = 0; i < ka->numRegions; ++i){
+        struct KRegion *r = &ka->regions[i];
+
+        for (struct nodeStruct *current = r->allocatedBlocks; current != NULL; current = current->next){
+            allocatedSize += current->size;
+            ++allocatedChunks;
+        }
+        for (struct nodeStruct *current = r->freeBlocks; current != NULL; current = current->next){
+            freeSize += current->size;
+            ++freeChunks;
+            largest = (current->size > largest) ? current->size : largest;
+            smallest = (smallest == 0 || current->size < smallest) ? current->size : smallest;
+        }
+    }
+
+    assert(stats.allocated_size == allocatedSize);
+    assert(stats.allocated_chunks == allocatedChunks);
+    assert(stats.free_size == freeSize);
+    assert(stats.free_chunks == freeChunks);
+    assert(stats.largest_free_chunk_size == largest);
+    assert(stats.smallest_free_chunk_size == smallest);
+}
+
+/* Points the blocks a compaction moved at their new addresses */
+static void follow_moves(void **_blocks, void **_before, void **_after, int _moves){
+    for (int i = 0; i < _moves; ++i){
+        for (int j = 0; j < TEST_BLOCKS; ++j){
+            if (_blocks[j] == _before[i]){
+                _blocks[j] = _after[i];
+                break;
+            }
+        }
+    }
+}
+
+/* get_stats stays equal to a list walk through kalloc, kfree, krealloc
+ * and both kinds of compaction, for every algorithm. */
+static void test_stats(void){
+    void *blocks[TEST_BLOCKS];
+    void *before[TEST_BLOCKS];
+    void *after[TEST_BLOCKS];
+
+    for (int algorithm = 0; algorithm < NUM_ALGORITHMS; ++algorithm){
+        for (int f = 0; f < NUM_TEST_FLAGS; ++f){
+            struct KAllocator *ka = kallocator_create(1 << 18, algorithm, testFlags[f]);
+            assert(ka != NULL);
+            memset(blocks, 0, sizeof(blocks));
+            srand(algorithm * NUM_TEST_FLAGS + f);
+            check_stats(ka);
+
+            for (int op = 0; op < 5000; ++op){
+                int i = rand() % TEST_BLOCKS;
+
+                if (op % 1000 == 999){
+                    follow_moves(blocks, before, after, kallocator_compact(ka, before, after));
+                } else if (op % 250 == 249){
+                    int done = 0;
+                    follow_moves(blocks, before, after, kallocator_compact_step(ka, 1024, before, after, &done));
+                } else if (blocks[i] == NULL){
+                    blocks[i] = kalloc_from(ka, 1 + rand() % 300);
+                } else if (rand() % 3 == 0){
+                    void *moved = krealloc_from(ka, blocks[i], 1 + rand() % 600);
+                    blocks[i] = (moved != NULL) ? moved : blocks[i];
+                } else {
+                    kfree_to(ka, blocks[i]);
+                    blocks[i] = NULL;
+                }
+                check_stats(ka);
+            }
+            kallocator_destroy(ka);
+        }
+    }
+    printf("get_stats matches the lists: passed\n");
+}
+
+/* kreloc_lookup translates pointers anywhere inside what a moved block's
+ * owner asked for, and leaves every other pointer alone. */
+static void test_reloc_lookup(void){
+    for (int f = 0; f < NUM_TEST_FLAGS; ++f){
+        struct KAllocator *ka = kallocator_create(1 << 16, FIRST_FIT, testFlags[f]);
+        char *hole = kalloc_from(ka, 100);
+        char *a = kalloc_from(ka, 37);
+        char *b = kalloc_from(ka, 20);
+        int local = 0;
+
+        memset(a, 'a', 37);
+        kfree_to(ka, hole);
+        struct krelocMap *map = kallocator_compact_map(ka);
+        assert(map != NULL);
+        assert(kreloc_count(map) == 2);
+
+        char *newA = kreloc_lookup(map, a);
+        char *newB = kreloc_lookup(map, b);
+        assert(newA < a && newB < b);
+        for (int i = 0; i < 37; ++i){
+            assert(kreloc_lookup(map, a + i) == newA + i);
+            assert(newA[i] == 'a');
+        }
+        assert(kreloc_lookup(map, b + 19) == newB + 19);
+
+        /* Before, between and after the moved blocks, and off the arena */
+        assert(kreloc_lookup(map, a - 1) == a - 1);
+        assert(kreloc_lookup(map, a + 37) == a + 37);
+        assert(kreloc_lookup(map, b + 20) == b + 20);
+        assert(kreloc_lookup(map, &local) == (void*)&local);
+
+        kreloc_free(map);
+        kallocator_destroy(ka);
+    }
+    printf("kreloc_lookup: passed\n");
+}
+
+/* Freeing the block between two free blocks merges all three into one
+ * free block, with or without boundary tags. */
+static void test_merge_neighbours(void){
+    int flags[] = {0, KALLOC_BOUNDARY_TAGS};
+
+    for (int f = 0; f < 2; ++f){
+        struct KAllocator *ka = kallocator_create(1 << 12, FIRST_FIT, flags[f]);
+        struct KRegion *r = &ka->regions[0];
+        int lead = has_tags(r) ? TAG_SIZE : 0;
+        char *below = kalloc_from(ka, 32);
+        char *middle = kalloc_from(ka, 32);
+        char *above = kalloc_from(ka, 32);
+        char *guard = kalloc_from(ka, 32);
+        int extent = (int)(guard - below);
+
+        kfree_to(ka, below);
+        kfree_to(ka, above);
+        assert(kallocator_get_stats(ka).free_chunks == 3);
+
+        kfree_to(ka, middle);
+        assert(kallocator_get_stats(ka).free_chunks == 2);
+        struct nodeStruct *merged = has_tags(r) ? Index_find(&r->freeIndex, below - lead)
+                : Tree_findBefore(r->freeTree, below + 1, NULL);
+        assert(merged != NULL && merged->ptr == below - lead);
+        assert(merged->size == extent);
+        if (has_tags(r)){
+            assert(tag_is_free(read_tag(below - lead)));
+            assert(tag_size(read_tag(below - lead)) == extent);
+            assert(read_tag(below - lead + extent - TAG_SIZE) == read_tag(below - lead));
+        }
+        check_stats(ka);
+
+        kfree_to(ka, guard);
+        kallocator_destroy(ka);
+    }
+    printf("merging both neighbours: passed\n");
+}
+
+/* kalloc_aligned returns blocks on the asked-for boundary, and they stay
+ * on it through compaction. The statistics count the sizes asked for,
+ * not what the alignment rounded them up to. */
+static void test_aligned(void){
+    void *blocks[TEST_BLOCKS];
+    int alignments[TEST_BLOCKS];
+    void *before[TEST_BLOCKS];
+    void *after[TEST_BLOCKS];
+
+    for (int algorithm = 0; algorithm < NUM_ALGORITHMS; ++algorithm){
+        for (int f = 0; f < NUM_TEST_FLAGS; ++f){
+            struct KAllocator *ka = kallocator_create(1 << 20, algorithm, testFlags[f]);
+            int count = 0;
+            int asked = 0;
+
+            memset(blocks, 0, sizeof(blocks));
+            for (int alignment = 8; alignment <= 4096; alignment *= 2){
+                for (int size = 1; size < 300; size += 97){
+                    /* Spacers leave the next block at an odd offset */
+                    blocks[count] = kalloc_from(ka, size);
+                    alignments[count++] = 1;
+                    blocks[count] = kalloc_aligned_from(ka, size, alignment);
+                    assert(blocks[count] != NULL);
+                    assert((uintptr_t)blocks[count] % alignment == 0);
+                    memset(blocks[count], 0xa5, size);
+                    alignments[count++] = alignment;
+                    asked += size;
+                }
+            }
+            for (int i = 0; i < count; i += 2){
+                kfree_to(ka, blocks[i]);
+                blocks[i] = NULL;
+            }
+            assert(kallocator_get_stats(ka).allocated_size == asked);
+
+            int moves = kallocator_compact(ka, before, after);
+            for (int i = 0; i < moves; ++i){
+                for (int j = 0; j < count; ++j){
+                    if (blocks[j] == before[i]){
+                        assert((uintptr_t)after[i] % alignments[j] == 0);
+                    }
+                }
+            }
+            check_stats(ka);
+            kallocator_destroy(ka);
+        }
+    }
+    printf("kalloc_aligned: passed\n");
+}
+
+int main(int argc, char* argv[]) {
+    test_stats();
+    test_reloc_lookup();
+    test_merge_neighbours();
+    test_aligned();
+    printf("All tests passed\n");
+    return 0;
+}